@@ -0,0 +1,31 @@
+/*
+ * adc_filter.c
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <string.h>
+#include "adc_filter.h"
+
+int adc_filter_init(struct adc_filter *filter, uint8_t type, uint8_t shift, uint8_t gain)
+{
+	if (!filter || !ADC_FILTER_CONFIG_VALID(type, shift, gain))
+		return -1;
+
+	memset(filter, 0, sizeof(struct adc_filter));
+	filter->type = type;
+	filter->shift = shift;
+	filter->out_shift = shift - gain;
+
+	return 0;
+}
+
+uint32_t adc_filter_output_rate(const struct adc_filter *filter, uint32_t sample_rate)
+{
+	return (filter->type == ADC_FILTER_BLOCK) ? sample_rate >> filter->shift : sample_rate;
+}
+
+uint32_t adc_filter_window_rate(const struct adc_filter *filter, uint32_t sample_rate)
+{
+	return sample_rate >> filter->shift;
+}
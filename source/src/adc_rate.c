@@ -0,0 +1,64 @@
+/*
+ * adc_rate.c
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <string.h>
+#include "adc_rate.h"
+
+int adc_rate_init(struct adc_rate_ctrl *ctrl, uint16_t up_steps, uint16_t down_steps,
+		uint16_t timeout_windows)
+{
+	if (!ctrl || (up_steps < down_steps))
+		return -1;
+
+	memset(ctrl, 0, sizeof(struct adc_rate_ctrl));
+	ctrl->up_steps = up_steps;
+	ctrl->down_steps = down_steps;
+	ctrl->timeout_windows = timeout_windows;
+	ctrl->mode = ADC_RATE_HIGH;
+
+	return 0;
+}
+
+uint8_t adc_rate_add_steps(struct adc_rate_ctrl *ctrl, uint32_t steps)
+{
+	ctrl->steps = (ctrl->steps + steps > UINT16_MAX) ? UINT16_MAX : ctrl->steps + steps;
+
+	if ((ctrl->mode == ADC_RATE_LOW) && (ctrl->steps >= ctrl->up_steps)) {
+		adc_rate_set_mode(ctrl, ADC_RATE_HIGH);
+		return 1;
+	}
+	return 0;
+}
+
+uint8_t adc_rate_window(struct adc_rate_ctrl *ctrl)
+{
+	uint8_t changed = 0;
+
+	if (ctrl->steps < ctrl->down_steps) {
+		if (ctrl->quiet_windows < UINT16_MAX)
+			ctrl->quiet_windows++;
+	}
+	else {
+		ctrl->quiet_windows = 0;
+	}
+
+	if ((ctrl->mode == ADC_RATE_HIGH) && (ctrl->quiet_windows >= ctrl->timeout_windows)) {
+		adc_rate_set_mode(ctrl, ADC_RATE_LOW);
+		changed = 1;
+	}
+	ctrl->steps = 0;
+
+	return changed;
+}
+
+void adc_rate_set_mode(struct adc_rate_ctrl *ctrl, uint8_t mode)
+{
+	if (ctrl->mode != mode)
+		ctrl->switches++;
+	ctrl->mode = mode;
+	ctrl->steps = 0;
+	ctrl->quiet_windows = 0;
+}
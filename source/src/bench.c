@@ -0,0 +1,286 @@
+/*
+ * bench.c
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include "platform_config.h"
+#include "rotary_cont_pot.h"
+#include "bench.h"
+
+#ifdef BENCHMARK
+
+#define BENCH_PERIOD	64	// samples per period of the gang waveforms
+#define BENCH_LOOPS		16	// number of periods for each benchmark
+#define BENCH_ADC_MAX	((1 << 12) - 1)
+
+static uint16_t m_adc1[BENCH_PERIOD];
+static uint16_t m_adc2[BENCH_PERIOD];
+
+/**
+ * Reference copy of the original if/else quadrant decoder. It's only
+ * used to compare the cycles against the current rcp_set_update_adc_values()
+ */
+struct bench_ref_pot {
+	tp_rcp_val	value;
+	tp_rcp_val	min;
+	tp_rcp_val	max;
+	tp_rcp_val	step;
+	uint8_t		prev_quarter;
+	uint16_t	min_adc_val[2];
+	uint16_t	max_adc_val[2];
+	uint8_t		dead_zone[2];
+	uint16_t	curr_adc_value[2];
+};
+
+static struct bench_ref_pot m_ref;
+
+#define REF_HALF(ADC_INDEX) ((m_ref.max_adc_val[ADC_INDEX] - m_ref.min_adc_val[ADC_INDEX]) >> 1)
+#define REF_IS_INCR(VAL1,VAL2) ((VAL1-VAL2) > 0 ? 1 : 0)
+#define REF_IS_DEADZONE(ADC_INDEX,VAL) ( \
+			(VAL > (m_ref.curr_adc_value[ADC_INDEX] - m_ref.dead_zone[ADC_INDEX])) \
+			&& (VAL < (m_ref.curr_adc_value[ADC_INDEX] + m_ref.dead_zone[ADC_INDEX])) \
+					)
+
+static void bench_ref_increment(void)
+{
+	if (m_ref.value < m_ref.max) {
+		tp_rcp_val tmp = m_ref.value + m_ref.step;
+		if (tmp > m_ref.max)
+			tmp = m_ref.max;
+		m_ref.value = tmp;
+	}
+}
+
+static void bench_ref_decrement(void)
+{
+	if (m_ref.value > m_ref.min) {
+		tp_rcp_val tmp = m_ref.value - m_ref.step;
+		if (tmp < m_ref.min)
+			tmp = m_ref.min;
+		m_ref.value = tmp;
+	}
+}
+
+static int __attribute__((noinline)) bench_ref_update(uint16_t adc1_val, uint16_t adc2_val)
+{
+	uint8_t quarter = 0;
+
+	if ((adc1_val <= REF_HALF(0)) && (adc2_val >= REF_HALF(1)))
+		quarter = 0;
+	else if ((adc1_val >= REF_HALF(0)) && (adc2_val >= REF_HALF(1)))
+		quarter = 1;
+	else if ((adc1_val >= REF_HALF(0)) && (adc2_val <= REF_HALF(1)))
+		quarter = 2;
+	else if ((adc1_val <= REF_HALF(0)) && (adc2_val <= REF_HALF(1)))
+		quarter = 3;
+
+	uint16_t prev1 = m_ref.curr_adc_value[0];
+	uint16_t prev2 = m_ref.curr_adc_value[1];
+
+	if (quarter == 0) {
+		if (REF_IS_DEADZONE(1,adc2_val)) return -2;
+		if (REF_IS_INCR(adc2_val,prev2) || (m_ref.prev_quarter == 3)) bench_ref_increment();
+		else bench_ref_decrement();
+	}
+	else if (quarter == 1) {
+		if (REF_IS_DEADZONE(0,adc1_val)) return -2;
+		if (REF_IS_INCR(adc1_val,prev1) || (m_ref.prev_quarter == 0)) bench_ref_increment();
+		else bench_ref_decrement();
+	}
+	else if (quarter == 2) {
+		if (REF_IS_DEADZONE(0,adc1_val)) return -2;
+		if (!REF_IS_INCR(adc1_val,prev1) || (m_ref.prev_quarter == 1)) bench_ref_increment();
+		else bench_ref_decrement();
+	}
+	else if (quarter == 3) {
+		if (REF_IS_DEADZONE(1,adc2_val)) return -2;
+		if (REF_IS_INCR(adc2_val,prev2) || (m_ref.prev_quarter == 2)) bench_ref_increment();
+		else bench_ref_decrement();
+	}
+	m_ref.prev_quarter = quarter;
+	m_ref.curr_adc_value[0] = adc1_val;
+	m_ref.curr_adc_value[1] = adc2_val;
+
+	return 0;
+}
+
+/**
+ * Create two triangle waveforms with 90 degrees phase, like the
+ * ones of the dual gang pot when it's turned right
+ */
+static void bench_gen_waveforms(void)
+{
+	for (int i=0; i<BENCH_PERIOD; i++) {
+		int p1 = i;
+		int p2 = (i + BENCH_PERIOD/4) % BENCH_PERIOD;
+		m_adc1[i] = (p1 < BENCH_PERIOD/2) ? (p1 * BENCH_ADC_MAX) / (BENCH_PERIOD/2)
+				: ((BENCH_PERIOD - p1) * BENCH_ADC_MAX) / (BENCH_PERIOD/2);
+		m_adc2[i] = (p2 < BENCH_PERIOD/2) ? (p2 * BENCH_ADC_MAX) / (BENCH_PERIOD/2)
+				: ((BENCH_PERIOD - p2) * BENCH_ADC_MAX) / (BENCH_PERIOD/2);
+	}
+}
+
+/* The bench pot has its own bank, so it doesn't use a slot of the
+ * application bank. It's attached only while the decoder benchmark runs.
+ */
+DECLARE_RCP_BANK(bench_pots, 1);
+
+static void bench_decoder(void)
+{
+	DECLARE_RCP_ADC(adc,0,BENCH_ADC_MAX,20);
+	en_trace_level trace_levels = glb.trace_levels;
+	uint32_t start, cycles_ref, cycles_new, cycles_block, primask;
+	int i;
+
+	m_ref.value = RCP_VAL(0);
+	m_ref.min = RCP_VAL(-100.0);
+	m_ref.max = RCP_VAL(100.0);
+	m_ref.step = RCP_VAL(0.25);
+	for (i=0; i<2; i++) {
+		m_ref.min_adc_val[i] = 0;
+		m_ref.max_adc_val[i] = BENCH_ADC_MAX;
+		m_ref.dead_zone[i] = 20;
+	}
+	m_ref.curr_adc_value[0] = m_adc1[0];
+	m_ref.curr_adc_value[1] = m_adc2[0];
+
+	/* The ADC DMA and SysTick interrupts would be counted in the measurements
+	 * and the ADC interrupt must not decode in the bench bank. The trace
+	 * output is disabled, because it can't be sent while the interrupts
+	 * are masked.
+	 */
+	glb.trace_levels = 0;
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (rcp_init(&bench_pots)) {
+		__set_PRIMASK(primask);
+		glb.trace_levels = trace_levels;
+		TRACE(("bench: the pots bank is already attached\n"));
+		return;
+	}
+	/* same configuration as the application pot */
+	int pot = rcp_add(m_adc1[0], m_adc2[0], RCP_VAL(0), RCP_VAL(-100.0), RCP_VAL(100.0),
+			RCP_VAL(0.25), &adc, &adc);
+	rcp_set_accel(pot, 100, 8);
+
+	start = bench_cycles();
+	for (i=0; i<BENCH_PERIOD*BENCH_LOOPS; i++)
+		bench_ref_update(m_adc1[i % BENCH_PERIOD], m_adc2[i % BENCH_PERIOD]);
+	cycles_ref = bench_cycles() - start;
+
+	start = bench_cycles();
+	for (i=0; i<BENCH_PERIOD*BENCH_LOOPS; i++)
+		rcp_set_update_adc_values(pot, m_adc1[i % BENCH_PERIOD], m_adc2[i % BENCH_PERIOD]);
+	cycles_new = bench_cycles() - start;
+
+	start = bench_cycles();
+	for (i=0; i<BENCH_LOOPS; i++)
+		rcp_update_block(pot, m_adc1, m_adc2, BENCH_PERIOD);
+	cycles_block = bench_cycles() - start;
+
+	/* detach the bench bank and drop its events */
+	rcp_deinit();
+
+	__set_PRIMASK(primask);
+	glb.trace_levels = trace_levels;
+
+	TRACE(("bench: decoder if/else: %lu cycles/sample\n",
+			(unsigned long) (cycles_ref / (BENCH_PERIOD*BENCH_LOOPS))));
+	TRACE(("bench: decoder table: %lu cycles/sample\n",
+			(unsigned long) (cycles_new / (BENCH_PERIOD*BENCH_LOOPS))));
+	TRACE(("bench: decoder block: %lu cycles/sample\n",
+			(unsigned long) (cycles_block / (BENCH_PERIOD*BENCH_LOOPS))));
+}
+
+/**
+ * The value backend of the library for the selected tp_rcp_val. To compare
+ * the backends, build with RCP_SUPPORT_FLOATS, RCP_SUPPORT_FIXED or none of
+ * them in rotary_cont_pot_decode.h.
+ */
+#if defined(RCP_SUPPORT_FLOATS)
+#define BENCH_VAL_NAME	"float"
+#elif defined(RCP_SUPPORT_FIXED)
+#define BENCH_VAL_NAME	"q16.16"
+#else
+#define BENCH_VAL_NAME	"uint16"
+#endif
+
+/* The step of the pot value in rcp_set_update_adc_values() */
+static int32_t __attribute__((noinline)) bench_val_ticks(volatile int32_t *ticks,
+		int32_t tick_min, int32_t tick_max, int dir)
+{
+	int32_t tmp = rcp_decode_ticks(*ticks, tick_min, tick_max, dir);
+	*ticks = tmp;
+	return tmp;
+}
+
+/* The pot value in rcp_get_value() */
+static tp_rcp_val __attribute__((noinline)) bench_val_get(tp_rcp_val start, int32_t ticks,
+		tp_rcp_val step, tp_rcp_val min, tp_rcp_val max)
+{
+	return rcp_val_from_ticks(start, ticks, step, min, max);
+}
+
+/* The ticks range in rcp_add() and rcp_set_value() */
+static int32_t __attribute__((noinline)) bench_val_steps(tp_rcp_val from, tp_rcp_val to,
+		tp_rcp_val step)
+{
+	return rcp_val_steps(from, to, step);
+}
+
+static void bench_values(void)
+{
+	/* the same range as the bench pot, [0, 100] for uint16_t */
+	const tp_rcp_val min = (RCP_VAL(-1) < 0) ? RCP_VAL(-100.0) : RCP_VAL(0);
+	const tp_rcp_val max = RCP_VAL(100.0);
+	const tp_rcp_val step = RCP_VAL(0.25) ? RCP_VAL(0.25) : RCP_VAL(1);
+	const int32_t tick_max = rcp_val_steps(min, max, step);
+	volatile int32_t val_ticks = 0;
+	volatile tp_rcp_val value;
+	volatile int32_t steps;
+	uint32_t start, cycles_ticks, cycles_get, cycles_steps, primask;
+	int i;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	/* A full period turning right and then left */
+	start = bench_cycles();
+	for (i=0; i<BENCH_PERIOD*BENCH_LOOPS; i++)
+		bench_val_ticks(&val_ticks, 0, tick_max, (i & BENCH_PERIOD) ? -1 : 1);
+	cycles_ticks = bench_cycles() - start;
+
+	start = bench_cycles();
+	for (i=0; i<BENCH_PERIOD*BENCH_LOOPS; i++)
+		value = bench_val_get(min, i & (BENCH_PERIOD - 1), step, min, max);
+	cycles_get = bench_cycles() - start;
+
+	start = bench_cycles();
+	for (i=0; i<BENCH_PERIOD*BENCH_LOOPS; i++)
+		steps = bench_val_steps(min, max - (i & (BENCH_PERIOD - 1)) * step, step);
+	cycles_steps = bench_cycles() - start;
+
+	__set_PRIMASK(primask);
+	(void) value;
+	(void) steps;
+
+	TRACE(("bench: value " BENCH_VAL_NAME " ticks: %lu cycles/update\n",
+			(unsigned long) (cycles_ticks / (BENCH_PERIOD*BENCH_LOOPS))));
+	TRACE(("bench: value " BENCH_VAL_NAME " get: %lu cycles/call\n",
+			(unsigned long) (cycles_get / (BENCH_PERIOD*BENCH_LOOPS))));
+	TRACE(("bench: value " BENCH_VAL_NAME " steps: %lu cycles/call\n",
+			(unsigned long) (cycles_steps / (BENCH_PERIOD*BENCH_LOOPS))));
+}
+
+void bench_run(void)
+{
+	bench_init();
+	bench_gen_waveforms();
+
+	bench_decoder();
+	bench_values();
+}
+
+#endif
@@ -14,17 +14,204 @@
 static struct dev_uart * dev_uart1 = NULL;
 static struct dev_uart * dev_uart2 = NULL;
 
+/**
+ * Start a DMA transfer of the contiguous TX data, up to the end of
+ * the ring. It's called with the DMA TX interrupt masked.
+ */
+static void dev_uart_dma_tx_start(struct dev_uart * uart)
+{
+	uint8_t *data;
+
+	uart->tx_dma_len = comm_buffer_tx_span(&uart->uart_buff, &data);
+	if (!uart->tx_dma_len) {
+		uart->uart_buff.tx_int_en = 0;
+		return;
+	}
+	uart->uart_buff.tx_int_en = 1;
+
+	DMA_Cmd(uart->tx_dma, DISABLE);
+	uart->tx_dma->CMAR = (uint32_t) data;
+	DMA_SetCurrDataCounter(uart->tx_dma, uart->tx_dma_len);
+	DMA_Cmd(uart->tx_dma, ENABLE);
+}
+
+/**
+ * Configure the DMA TX channel of the port
+ */
+static void dev_uart_dma_tx_add(struct dev_uart * uart)
+{
+	DMA_InitTypeDef DMA_InitStructure;
+	NVIC_InitTypeDef NVIC_InitStructure;
+
+	if (uart->port == USART1) {
+		uart->tx_dma = DMA1_Channel4;
+		uart->tx_dma_tc = DMA1_IT_TC4;
+		NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel4_IRQn;
+		NVIC_InitStructure.NVIC_IRQChannelSubPriority = 5;
+	}
+	else {
+		uart->tx_dma = DMA1_Channel7;
+		uart->tx_dma_tc = DMA1_IT_TC7;
+		NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel7_IRQn;
+		NVIC_InitStructure.NVIC_IRQChannelSubPriority = 6;
+	}
+	uart->tx_dma_len = 0;
+
+	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+
+	DMA_DeInit(uart->tx_dma);
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t) &uart->port->DR;
+	DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t) uart->uart_buff.tx_buffer;
+	DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
+	DMA_InitStructure.DMA_BufferSize = 1;
+	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+	DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_Low;
+	DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+	DMA_Init(uart->tx_dma, &DMA_InitStructure);
+	DMA_ITConfig(uart->tx_dma, DMA_IT_TC, ENABLE);
+
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStructure);
+
+	USART_DMACmd(uart->port, USART_DMAReq_Tx, ENABLE);
+}
+
+/**
+ * Configure the circular DMA RX channel of the port and the idle line interrupt
+ */
+static void dev_uart_dma_rx_add(struct dev_uart * uart)
+{
+	DMA_InitTypeDef DMA_InitStructure;
+	NVIC_InitTypeDef NVIC_InitStructure;
+
+	if (uart->port == USART1) {
+		uart->rx_dma = DMA1_Channel5;
+		uart->rx_dma_it = DMA1_IT_GL5;
+		NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel5_IRQn;
+		NVIC_InitStructure.NVIC_IRQChannelSubPriority = 5;
+	}
+	else {
+		uart->rx_dma = DMA1_Channel6;
+		uart->rx_dma_it = DMA1_IT_GL6;
+		NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel6_IRQn;
+		NVIC_InitStructure.NVIC_IRQChannelSubPriority = 6;
+	}
+	uart->rx_dma_pos = 0;
+	uart->rx_dma_received = 0;
+	uart->rx_dma_frame_end = 0;
+	uart->rx_dma_handled = 0;
+
+	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+
+	DMA_DeInit(uart->rx_dma);
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t) &uart->port->DR;
+	DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t) uart->uart_buff.rx_buffer;
+	DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
+	DMA_InitStructure.DMA_BufferSize = uart->uart_buff.rx_buffer_size;
+	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+	DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_Medium;
+	DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+	DMA_Init(uart->rx_dma, &DMA_InitStructure);
+	/* The half and complete transfer interrupts count the received bytes
+	 * at least twice per buffer, so the count can't miss a wrap-around */
+	DMA_ITConfig(uart->rx_dma, DMA_IT_HT | DMA_IT_TC, ENABLE);
+	DMA_Cmd(uart->rx_dma, ENABLE);
+
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStructure);
+
+	USART_DMACmd(uart->port, USART_DMAReq_Rx, ENABLE);
+	USART_ITConfig(uart->port, USART_IT_IDLE, ENABLE);
+	/* There's no RXNE interrupt, so the overruns need the error interrupt */
+	USART_ITConfig(uart->port, USART_IT_ERR, ENABLE);
+}
+
+/**
+ * Add the bytes that the DMA received since the last call to rx_dma_received.
+ * It's called from the DMA RX and the USART interrupts, which can't preempt
+ * each other.
+ */
+static void dev_uart_dma_rx_count(struct dev_uart * uart)
+{
+	uint16_t size = uart->uart_buff.rx_buffer_size;
+	uint16_t pos = (size - DMA_GetCurrDataCounter(uart->rx_dma)) % size;
+
+	uart->rx_dma_received += (pos + size - uart->rx_dma_pos) % size;
+	uart->rx_dma_pos = pos;
+}
+
+/**
+ * Get the bytes that the DMA has received until now, from the main loop.
+ * The interrupts are disabled, because the count is updated in the DMA RX
+ * and the USART interrupts.
+ */
+static uint32_t dev_uart_dma_rx_received(struct dev_uart * uart)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	dev_uart_dma_rx_count(uart);
+	uint32_t received = uart->rx_dma_received;
+	__set_PRIMASK(primask);
+
+	return received;
+}
+
+/**
+ * Half/complete transfer handler of the DMA RX channel
+ */
+static void dev_uart_dma_rx_irq(struct dev_uart * uart)
+{
+	if (DMA_GetITStatus(uart->rx_dma_it) == RESET)
+		return;
+	DMA_ClearITPendingBit(uart->rx_dma_it);
+
+	dev_uart_dma_rx_count(uart);
+}
+
+/**
+ * Transfer complete handler of the DMA TX channel. Frees the sent span and
+ * sends the rest of the ring, if any.
+ */
+static void dev_uart_dma_tx_irq(struct dev_uart * uart)
+{
+	if (DMA_GetITStatus(uart->tx_dma_tc) == RESET)
+		return;
+	DMA_ClearITPendingBit(uart->tx_dma_tc);
+
+	comm_buffer_tx_consume(&uart->uart_buff, uart->tx_dma_len);
+	uart->tx_dma_len = 0;
+	dev_uart_dma_tx_start(uart);
+}
+
 void dev_uart_add(struct dev_uart * uart)
 {
-	if (!uart || !uart->port || !uart->uart_buff.rx_buffer_size || !uart->uart_buff.tx_buffer_size) return;
+	if (!uart || !uart->port || !uart->uart_buff.rx_buffer_size) return;
+	if (!COMM_BUFFER_SIZE_VALID(uart->uart_buff.tx_buffer_size)) return;
+	if ((uart->flags & DEV_UART_DMA_RX) && !uart->rx_frame) return;
 
 	/* Create buffers */
 	uart->uart_buff.rx_buffer = (uint8_t*)malloc(uart->uart_buff.rx_buffer_size);
 	uart->uart_buff.tx_buffer = (uint8_t*)malloc(uart->uart_buff.tx_buffer_size);
+	if (!uart->uart_buff.rx_buffer || !uart->uart_buff.tx_buffer) {
+		free(uart->uart_buff.rx_buffer);
+		free(uart->uart_buff.tx_buffer);
+		uart->uart_buff.rx_buffer = NULL;
+		uart->uart_buff.tx_buffer = NULL;
+		return;
+	}
 
 	/* reset TX */
 	uart->uart_buff.tx_int_en = 0;
-	uart->uart_buff.tx_length = 0;
 	uart->uart_buff.tx_ptr_in = 0;
 	uart->uart_buff.tx_ptr_out = 0;
 	uart->uart_buff.tx_ready = 0;
@@ -32,6 +219,8 @@ void dev_uart_add(struct dev_uart * uart)
 	uart->uart_buff.rx_ready = 0;
 	uart->uart_buff.rx_ready_tmr = 0;
 	uart->uart_buff.rx_ptr_in = 0;
+	uart->uart_buff.rx_ptr_out = 0;
+	memset((void*) &uart->stats, 0, sizeof(struct dev_uart_stats));
 
 	if (uart->port == USART1) {
 		RCC_APB2PeriphClockCmd(RCC_APB2Periph_USART1 | RCC_APB2Periph_GPIOA | RCC_APB2Periph_AFIO, ENABLE);
@@ -70,7 +259,10 @@ void dev_uart_add(struct dev_uart * uart)
 	 Jump to the USART1_IRQHandler() function
 	 if the USART1 receive interrupt occurs
 	 */
-	USART_ITConfig(uart->port, USART_IT_RXNE, ENABLE); // enable the USART receive interrupt
+	if (uart->flags & DEV_UART_DMA_RX)
+		dev_uart_dma_rx_add(uart);
+	else
+		USART_ITConfig(uart->port, USART_IT_RXNE, ENABLE); // enable the USART receive interrupt
 
 	NVIC_PriorityGroupConfig(NVIC_PriorityGroup_0);
 	if (uart->port == USART1) {
@@ -84,6 +276,9 @@ void dev_uart_add(struct dev_uart * uart)
 	uart->nvic.NVIC_IRQChannelCmd = ENABLE;	// the USART1 interrupts are globally enabled
 	NVIC_Init(&uart->nvic);	// the properties are passed to the NVIC_Init function which takes care of the low level stuff
 
+	if (uart->flags & DEV_UART_DMA_TX)
+		dev_uart_dma_tx_add(uart);
+
 	/* Enable the USART */
 	USART_Cmd(uart->port, ENABLE);
 
@@ -93,6 +288,25 @@ void dev_uart_add(struct dev_uart * uart)
 		dev_uart2 = uart;
 }
 
+void dev_uart_set_tx_policy(struct dev_uart * uart, uint8_t policy, uint16_t timeout_ms,
+		dev_uart_time_cb time_ms)
+{
+	/* blocking without a time base would never time out */
+	if ((policy == DEV_UART_TX_BLOCK) && !time_ms)
+		policy = DEV_UART_TX_DROP_NEWEST;
+	uart->tx_policy = policy;
+	uart->tx_timeout_ms = timeout_ms;
+	uart->fp_time_ms = time_ms;
+}
+
+void dev_uart_get_stats(struct dev_uart * uart, struct dev_uart_stats * stats)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	*stats = uart->stats;
+	__set_PRIMASK(primask);
+}
+
 void dev_uart_set_baud_rate(struct dev_uart * uart, uint32_t baudrate)
 {
 	uart->config.USART_BaudRate = baudrate;
@@ -116,6 +330,18 @@ void dev_uart_remove(struct dev_uart * uart)
 		uart->nvic.NVIC_IRQChannelCmd = DISABLE;
 		USART_ITConfig(uart->port, USART_IT_RXNE, DISABLE);
 		NVIC_Init(&uart->nvic);
+		if (uart->flags & DEV_UART_DMA_TX) {
+			USART_DMACmd(uart->port, USART_DMAReq_Tx, DISABLE);
+			DMA_ITConfig(uart->tx_dma, DMA_IT_TC, DISABLE);
+			DMA_DeInit(uart->tx_dma);
+		}
+		if (uart->flags & DEV_UART_DMA_RX) {
+			USART_ITConfig(uart->port, USART_IT_IDLE, DISABLE);
+			USART_ITConfig(uart->port, USART_IT_ERR, DISABLE);
+			USART_DMACmd(uart->port, USART_DMAReq_Rx, DISABLE);
+			DMA_ITConfig(uart->rx_dma, DMA_IT_HT | DMA_IT_TC, DISABLE);
+			DMA_DeInit(uart->rx_dma);
+		}
 		USART_Cmd(uart->port, DISABLE);
 		USART_DeInit(uart->port);
 		if (uart->port == USART1)
@@ -127,25 +353,117 @@ void dev_uart_remove(struct dev_uart * uart)
 
 
 /**
- * This is a (weak) function in syscalls.c and is used from printf
- * to print data to the UART1
+ * Start sending the TX ring, if the TXE interrupt or the DMA is idle
  */
-int dev_uart_send(struct dev_uart * uart, int ch)
+static void dev_uart_tx_start(struct dev_uart * uart)
 {
-	if ((uart->uart_buff.tx_ptr_in + 1)%uart->uart_buff.tx_buffer_size == uart->uart_buff.tx_ptr_out) {
-		return -1;
+	if (uart->flags & DEV_UART_DMA_TX) {
+		/* If the DMA is idle then start it. The bytes that are added while
+		 * it runs are sent from the transfer complete interrupt. */
+		if (!uart->uart_buff.tx_int_en) {
+			uint32_t primask = __get_PRIMASK();
+			__disable_irq();
+			if (!uart->uart_buff.tx_int_en)
+				dev_uart_dma_tx_start(uart);
+			__set_PRIMASK(primask);
+		}
+		return;
 	}
 
-	uart->uart_buff.tx_length++;
-	uart->uart_buff.tx_buffer[uart->uart_buff.tx_ptr_in] = ch;
-	uart->uart_buff.tx_ptr_in = (uart->uart_buff.tx_ptr_in + 1)%uart->uart_buff.tx_buffer_size;
-
-	/* If INT is disabled then enable it */
+	/* If INT is disabled then enable it. The RX interrupt stays enabled
+	 * and the CR1 update can't race with the TXE interrupt that disables it */
 	if (!uart->uart_buff.tx_int_en) {
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
 		uart->uart_buff.tx_int_en = 1;
-		USART_ITConfig(uart->port, USART_IT_TXE, ENABLE); 	// enable the USART1 receive interrupt
-		USART_ITConfig(uart->port, USART_IT_RXNE, DISABLE);
+		USART_ITConfig(uart->port, USART_IT_TXE, ENABLE);
+		__set_PRIMASK(primask);
 	}
+}
+
+/**
+ * Make room for len bytes in the TX ring by dropping its oldest bytes.
+ * The consumer can't run meanwhile and a DMA transfer is stopped after
+ * the bytes that it has already sent. Nothing is done if the data fit.
+ */
+static void dev_uart_tx_drop_oldest(struct dev_uart * uart, uint16_t len)
+{
+	if (len <= comm_buffer_tx_free(&uart->uart_buff))
+		return;
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	if ((uart->flags & DEV_UART_DMA_TX) && uart->tx_dma_len) {
+		DMA_Cmd(uart->tx_dma, DISABLE);
+		DMA_ClearITPendingBit(uart->tx_dma_tc);
+		comm_buffer_tx_consume(&uart->uart_buff, uart->tx_dma_len - DMA_GetCurrDataCounter(uart->tx_dma));
+		uart->tx_dma_len = 0;
+		uart->uart_buff.tx_int_en = 0;
+	}
+
+	/* the consumer may have freed some space meanwhile */
+	uint16_t free = comm_buffer_tx_free(&uart->uart_buff);
+	if (len > free) {
+		comm_buffer_tx_consume(&uart->uart_buff, len - free);
+		uart->stats.tx_dropped += len - free;
+	}
+	__set_PRIMASK(primask);
+}
+
+/**
+ * Blocking needs the TX interrupts and the time base, so it's only
+ * allowed in thread mode with the interrupts enabled
+ */
+static inline uint8_t dev_uart_tx_can_block(void)
+{
+	return !__get_PRIMASK() && !__get_IPSR();
+}
+
+/**
+ * Add data to the TX ring with the TX policy of the device
+ */
+static size_t dev_uart_tx_write(struct dev_uart * uart, const uint8_t * data, size_t len)
+{
+	struct tp_comm_buffer *buff = &uart->uart_buff;
+	uint8_t block = (uart->tx_policy == DEV_UART_TX_BLOCK) && dev_uart_tx_can_block();
+	uint32_t start_ms = block ? uart->fp_time_ms() : 0;
+	size_t sent = 0;
+
+	while (sent < len) {
+		size_t chunk = len - sent;
+		if (chunk > buff->tx_buffer_size)
+			chunk = buff->tx_buffer_size;
+		if (uart->tx_policy == DEV_UART_TX_DROP_OLDEST)
+			dev_uart_tx_drop_oldest(uart, chunk);
+
+		uint16_t n = comm_buffer_tx_write(buff, &data[sent], chunk);
+		if (n) {
+			uint16_t used = comm_buffer_tx_used(buff);
+			if (used > uart->stats.tx_high_water)
+				uart->stats.tx_high_water = used;
+			sent += n;
+			dev_uart_tx_start(uart);
+			continue;
+		}
+		if (!block || ((uart->fp_time_ms() - start_ms) >= uart->tx_timeout_ms))
+			break;
+	}
+	uart->stats.tx_dropped += len - sent;
+
+	return sent;
+}
+
+/**
+ * This is a (weak) function in syscalls.c and is used from printf
+ * to print data to the UART1
+ */
+int dev_uart_send(struct dev_uart * uart, int ch)
+{
+	uint8_t data = ch;
+
+	if (!dev_uart_tx_write(uart, &data, 1))
+		return -1;
 
 	return ch;
 }
@@ -153,11 +471,7 @@ int dev_uart_send(struct dev_uart * uart, int ch)
 
 size_t dev_uart_send_buffer(struct dev_uart * uart, uint8_t * buffer, size_t buffer_len)
 {
-	size_t i = 0;
-	for (i=0; i<buffer_len; i++) {
-		if (dev_uart_send(uart, buffer[i]) < 0) break;
-	}
-	return i;
+	return dev_uart_tx_write(uart, buffer, buffer_len);
 }
 
 void USART1_IRQHandler(void)
@@ -171,8 +485,79 @@ void USART2_IRQHandler(void)
 	if (dev_uart2) dev_uart_irq(dev_uart2);
 }
 
+void DMA1_Channel4_IRQHandler(void)
+{
+	if (dev_uart1) dev_uart_dma_tx_irq(dev_uart1);
+}
+
+void DMA1_Channel5_IRQHandler(void)
+{
+	if (dev_uart1) dev_uart_dma_rx_irq(dev_uart1);
+}
+
+void DMA1_Channel6_IRQHandler(void)
+{
+	if (dev_uart2) dev_uart_dma_rx_irq(dev_uart2);
+}
+
+void DMA1_Channel7_IRQHandler(void)
+{
+	if (dev_uart2) dev_uart_dma_tx_irq(dev_uart2);
+}
+
+/**
+ * Hand the frames that the DMA received until the last idle line
+ * to the callback. A frame that wraps around the end of the circular
+ * buffer is copied in two parts. The DMA keeps writing the next frame
+ * while the frame is copied, so if more than the buffer size was received
+ * since the start of the frame, before or after the copy, the DMA has
+ * overwritten the oldest bytes and the frame is discarded.
+ */
+static void dev_uart_dma_rx_update(struct dev_uart * uart)
+{
+	if (!uart->uart_buff.rx_ready)
+		return;
+	uart->uart_buff.rx_ready = 0;
+
+	uint16_t size = uart->uart_buff.rx_buffer_size;
+	uint16_t ptr_out = uart->uart_buff.rx_ptr_out;
+	uint32_t frame_start = uart->rx_dma_handled;
+	uint32_t frame_end = uart->rx_dma_frame_end;
+	uint32_t len = frame_end - frame_start;
+
+	uart->rx_dma_handled = frame_end;
+	uart->uart_buff.rx_ptr_out = (ptr_out + len) % size;
+
+	if ((dev_uart_dma_rx_received(uart) - frame_start) > size) {
+		uart->stats.rx_discards += len;
+		return;
+	}
+
+	uint16_t span = size - ptr_out;
+	if (span > len)
+		span = len;
+	memcpy(uart->rx_frame, &uart->uart_buff.rx_buffer[ptr_out], span);
+	memcpy(&uart->rx_frame[span], uart->uart_buff.rx_buffer, len - span);
+
+	if ((dev_uart_dma_rx_received(uart) - frame_start) > size) {
+		uart->stats.rx_discards += len;
+		return;
+	}
+
+	if (len) {
+		uart->available = 1;
+		if (uart->fp_dev_uart_cb)
+			uart->fp_dev_uart_cb(uart->rx_frame, len, 0);
+	}
+}
+
 void dev_uart_update(struct dev_uart * uart)
 {
+	if (uart->flags & DEV_UART_DMA_RX) {
+		dev_uart_dma_rx_update(uart);
+		return;
+	}
+
 	if (uart->uart_buff.rx_ready) {
 		if ((uart->uart_buff.rx_ready_tmr++) >= uart->timeout_ms) {
 			uart->uart_buff.rx_ready = 0;
@@ -189,37 +574,62 @@ void dev_uart_update(struct dev_uart * uart)
 
 void dev_uart_irq(struct dev_uart * uart)
 {
-	if (USART_GetITStatus(uart->port, USART_IT_RXNE) != RESET) {
+	/* The ORE flag is cleared by reading the SR and then the DR, which is done
+	 * below by the RXNE handler, or in DMA RX mode by the DMA or the error handler */
+	if (USART_GetFlagStatus(uart->port, USART_FLAG_ORE) != RESET)
+		uart->stats.rx_overruns++;
+
+	if ((uart->flags & DEV_UART_DMA_RX) && (USART_GetITStatus(uart->port, USART_IT_IDLE) != RESET)) {
+		/* The IDLE flag is cleared by reading the SR and then the DR. If
+		 * there's a new byte, the DMA reads the DR and clears the flag */
+		if (USART_GetFlagStatus(uart->port, USART_FLAG_RXNE) == RESET)
+			USART_ReceiveData(uart->port);
+		/* The frame ends at the current DMA write position */
+		dev_uart_dma_rx_count(uart);
+		uint32_t pending = uart->rx_dma_received - uart->rx_dma_handled;
+		if (pending > uart->stats.rx_high_water)
+			uart->stats.rx_high_water = (pending > 0xFFFF) ? 0xFFFF : pending;
+		uart->rx_dma_frame_end = uart->rx_dma_received;
+		uart->uart_buff.rx_ready = 1;
+	}
+
+	if (!(uart->flags & DEV_UART_DMA_RX) && (USART_GetITStatus(uart->port, USART_IT_RXNE) != RESET)) {
 		/* Read one byte from the receive data register */
 		if (uart->uart_buff.rx_ptr_in == uart->uart_buff.rx_buffer_size) {
 			uart->port->DR;	//discard data
-			return;
+			uart->stats.rx_discards++;
 		}
-		uart->uart_buff.rx_buffer[uart->uart_buff.rx_ptr_in++] = uart->port->DR;
+		else {
+			uart->uart_buff.rx_buffer[uart->uart_buff.rx_ptr_in++] = uart->port->DR;
+			if (uart->uart_buff.rx_ptr_in > uart->stats.rx_high_water)
+				uart->stats.rx_high_water = uart->uart_buff.rx_ptr_in;
 
-		/* Disable the USARTy Receive interrupt */
-		/* flag the byte reception */
-		uart->uart_buff.rx_ready = 1;
-		/* reset receive expire timer */
-		uart->uart_buff.rx_ready_tmr = 0;
-//		uart->port->SR &= ~USART_FLAG_RXNE;	          // clear interrupt
+			/* flag the byte reception */
+			uart->uart_buff.rx_ready = 1;
+			/* reset receive expire timer */
+			uart->uart_buff.rx_ready_tmr = 0;
+		}
+	}
+
+	/* In DMA RX mode the error interrupt is enabled. If the DMA has already
+	 * read the byte, it can't clear the error flags, so the DR is read here.
+	 * This is done after the IDLE handler, because it clears the IDLE flag too. */
+	if (uart->flags & DEV_UART_DMA_RX) {
+		uint16_t sr = uart->port->SR;
+		if ((sr & (USART_FLAG_ORE | USART_FLAG_NE | USART_FLAG_FE)) && !(sr & USART_FLAG_RXNE))
+			USART_ReceiveData(uart->port);
 	}
 
 	if (USART_GetITStatus(uart->port, USART_IT_TXE) != RESET) {
-		if (uart->uart_buff.tx_ptr_out != uart->uart_buff.tx_ptr_in) {
-			uart->port->DR = uart->uart_buff.tx_buffer[uart->uart_buff.tx_ptr_out];
-			uart->uart_buff.tx_ptr_out = (uart->uart_buff.tx_ptr_out + 1)%uart->uart_buff.tx_buffer_size;
-			uart->uart_buff.tx_length--;
+		uint8_t data;
+		if (comm_buffer_tx_read(&uart->uart_buff, &data, 1)) {
+			uart->port->DR = data;
 		}
 		else {
-			/* Disable the USARTy Transmit interrupt */
+			/* Disable the USARTy Transmit interrupt. The indexes are free-running,
+			 * so they are not reset */
 			USART_ITConfig(uart->port, USART_IT_TXE, DISABLE);
-			USART_ITConfig(uart->port, USART_IT_RXNE, ENABLE);
 			uart->uart_buff.tx_int_en = 0;
-			/* Rest uart buffer */
-			uart->uart_buff.tx_ptr_in = 0;
-			uart->uart_buff.tx_ptr_out = 0;
-			uart->uart_buff.tx_length = 0;
 		}
 //		uart->port->SR &= ~USART_FLAG_TXE;	          // clear interrupt
 	}
@@ -50,12 +50,16 @@ void NVIC_Configuration(void)
 {
 	NVIC_InitTypeDef NVIC_InitStructure;
 
-	/* Configure and enable ADC interrupt */
-	NVIC_InitStructure.NVIC_IRQChannel = ADC1_2_IRQn;
+	/* Configure and enable the ADC DMA interrupt */
+	NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel1_IRQn;
 	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0;
 	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
 	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
 	NVIC_Init(&NVIC_InitStructure);
+
+	/* Configure and enable the ADC interrupt for the analog watchdog */
+	NVIC_InitStructure.NVIC_IRQChannel = ADC1_2_IRQn;
+	NVIC_Init(&NVIC_InitStructure);
 }
 
 void GPIO_Configuration(void)
@@ -73,30 +77,55 @@ void GPIO_Configuration(void)
 void ADC_Configuration(void)
 {
 	ADC_InitTypeDef ADC_InitStructure;
+	DMA_InitTypeDef DMA_InitStructure;
 
 	/* Enable ADC1&2 and GPIOC clock */
 	RCC_APB2PeriphClockCmd(RCC_APB2Periph_ADC1 | RCC_APB2Periph_ADC2 | RCC_APB2Periph_GPIOA, ENABLE);
 
-	ADC_InitStructure.ADC_Mode = ADC_Mode_Independent;
+	/* DMA1 channel1 configuration ----------------------------------------------*/
+	/* In dual mode ADC1->DR has ADC1 in the low and ADC2 in the high half-word,
+	 * so each pair is a single word. The buffer is circular and the half/full
+	 * transfer interrupts average each half. */
+	DMA_DeInit(DMA1_Channel1);
+	DMA_InitStructure.DMA_PeripheralBaseAddr = ADC1_DR_Address;
+	DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t) glb.adc_dma_buffer;
+	DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
+	DMA_InitStructure.DMA_BufferSize = ADC_DMA_BUFFER_SIZE;
+	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Word;
+	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Word;
+	DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+	DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+	DMA_Init(DMA1_Channel1, &DMA_InitStructure);
+	DMA_ITConfig(DMA1_Channel1, DMA_IT_HT | DMA_IT_TC, ENABLE);
+	/* Enable DMA1 Channel1 */
+	DMA_Cmd(DMA1_Channel1, ENABLE);
+
+	/* Both gangs are sampled at the same time */
+	ADC_InitStructure.ADC_Mode = ADC_Mode_RegSimult;
 	ADC_InitStructure.ADC_ScanConvMode = DISABLE;
-	ADC_InitStructure.ADC_ContinuousConvMode = ENABLE;
-	ADC_InitStructure.ADC_ExternalTrigConv = ADC_ExternalTrigConv_None;
+	ADC_InitStructure.ADC_ContinuousConvMode = DISABLE;
 	ADC_InitStructure.ADC_DataAlign = ADC_DataAlign_Right;
 	ADC_InitStructure.ADC_NbrOfChannel = 1;
 
 	/* ADC1 configuration ------------------------------------------------------*/
+	/* ADC1 is triggered from TIM3, see ADC_SampleRate_Configuration() */
+	ADC_InitStructure.ADC_ExternalTrigConv = ADC_ExternalTrigConv_T3_TRGO;
 	ADC_Init(ADC1, &ADC_InitStructure);
 	/* ADC3 regular channel14 configuration */
 	ADC_RegularChannelConfig(ADC1, ADC_Channel_0, 1, ADC_SampleTime_239Cycles5);
-	/* Enable ADC1 EOC interrupt */
-	ADC_ITConfig(ADC1, ADC_IT_EOC, ENABLE);
+	/* Enable ADC1 DMA */
+	ADC_DMACmd(ADC1, ENABLE);
 
 	/* ADC2 configuration ------------------------------------------------------*/
+	ADC_InitStructure.ADC_ExternalTrigConv = ADC_ExternalTrigConv_None;
 	ADC_Init(ADC2, &ADC_InitStructure);
 	/* ADC3 regular channel14 configuration */
 	ADC_RegularChannelConfig(ADC2, ADC_Channel_1, 1, ADC_SampleTime_239Cycles5);
-	/* Enable ADC2 EOC interrupt */
-	ADC_ITConfig(ADC2, ADC_IT_EOC, ENABLE);
+	/* ADC2 is started by ADC1 */
+	ADC_ExternalTrigConvCmd(ADC2, ENABLE);
 
 
 	/* Enable ADC1 */
@@ -121,8 +150,100 @@ void ADC_Configuration(void)
 	/* Check the end of ADC2 calibration */
 	while(ADC_GetCalibrationStatus(ADC2));
 
-	/* Start ADC1 Software Conversion */
-	ADC_SoftwareStartConvCmd(ADC1, ENABLE);
-	/* Start ADC2 Software Conversion */
-	ADC_SoftwareStartConvCmd(ADC2, ENABLE);
+	/* Start ADC1 conversions on the TIM3 trigger, which also starts ADC2 */
+	ADC_ExternalTrigConvCmd(ADC1, ENABLE);
+}
+
+/**
+ * @brief Set the rate that TIM3 triggers the ADCs. The rate is limited by
+ * 		the ADC conversion time (12.5 + 239.5 ADC clock cycles).
+ * @param[in] rate_hz The requested rate in pairs per second
+ * @return uint32_t The actual rate in Hz, which is the closest that the timer
+ * 		can divide to, or 0 if rate_hz is 0 and the sampling is stopped
+ */
+uint32_t ADC_SampleRate_Configuration(uint32_t rate_hz)
+{
+	TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+	RCC_ClocksTypeDef clocks;
+
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM3, ENABLE);
+	TIM_Cmd(TIM3, DISABLE);
+	if (!rate_hz)
+		return 0;
+
+	RCC_GetClocksFreq(&clocks);
+	/* The APB1 timers clock is x2 when the APB1 prescaler isn't 1 */
+	uint32_t tim_clk = (clocks.PCLK1_Frequency == clocks.HCLK_Frequency) ?
+			clocks.PCLK1_Frequency : clocks.PCLK1_Frequency * 2;
+	uint32_t max_rate = clocks.ADCCLK_Frequency / (12 + 240);
+
+	if (rate_hz > max_rate)
+		rate_hz = max_rate;
+
+	uint32_t ticks = tim_clk / rate_hz;
+	uint32_t prescaler = (ticks >> 16) + 1;
+	uint32_t period = ticks / prescaler;
+
+	TIM_TimeBaseStructInit(&TIM_TimeBaseStructure);
+	TIM_TimeBaseStructure.TIM_Prescaler = prescaler - 1;
+	TIM_TimeBaseStructure.TIM_Period = period - 1;
+	TIM_TimeBaseStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+	TIM_TimeBaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+	TIM_TimeBaseInit(TIM3, &TIM_TimeBaseStructure);
+	/* Trigger the ADC on every update event */
+	TIM_SelectOutputTrigger(TIM3, TIM_TRGOSource_Update);
+	TIM_Cmd(TIM3, ENABLE);
+
+	return tim_clk / (prescaler * period);
+}
+
+static void ADC_AnalogWatchdog_Configuration(ADC_TypeDef* ADCx, uint8_t channel,
+		uint16_t val, uint16_t margin)
+{
+	uint16_t low = (val > margin) ? val - margin : 0;
+	uint16_t high = ((val + margin) < 0xFFF) ? val + margin : 0xFFF;
+
+	ADC_AnalogWatchdogThresholdsConfig(ADCx, high, low);
+	ADC_AnalogWatchdogSingleChannelConfig(ADCx, channel);
+	ADC_ClearITPendingBit(ADCx, ADC_IT_AWD);
+	ADC_AnalogWatchdogCmd(ADCx, ADC_AnalogWatchdog_SingleRegEnable);
+	ADC_ITConfig(ADCx, ADC_IT_AWD, ENABLE);
+}
+
+/**
+ * @brief Enter the idle mode. The ADCs are sampled slowly and the DMA
+ * 		interrupts are disabled, so nothing is filtered or decoded, and the
+ * 		analog watchdogs fire when a gang leaves the [val - margin, val + margin]
+ * 		window. Then ADC1_2_IRQHandler restores the full rate.
+ * @param[in] adc1_val The last value of the first gang
+ * @param[in] adc2_val The last value of the second gang
+ * @param[in] margin The window half width
+ * @param[in] rate_hz The idle sample rate
+ */
+void ADC_Idle_Configuration(uint16_t adc1_val, uint16_t adc2_val, uint16_t margin, uint32_t rate_hz)
+{
+	DMA_ITConfig(DMA1_Channel1, DMA_IT_HT | DMA_IT_TC, DISABLE);
+	ADC_SampleRate_Configuration(rate_hz);
+	ADC_AnalogWatchdog_Configuration(ADC1, ADC_Channel_0, adc1_val, margin);
+	ADC_AnalogWatchdog_Configuration(ADC2, ADC_Channel_1, adc2_val, margin);
+}
+
+/**
+ * @brief Exit the idle mode and restore the full rate sampling
+ * @param[in] rate_hz The sample rate
+ * @return uint32_t The actual sample rate
+ */
+uint32_t ADC_Active_Configuration(uint32_t rate_hz)
+{
+	ADC_ITConfig(ADC1, ADC_IT_AWD, DISABLE);
+	ADC_ITConfig(ADC2, ADC_IT_AWD, DISABLE);
+	ADC_AnalogWatchdogCmd(ADC1, ADC_AnalogWatchdog_None);
+	ADC_AnalogWatchdogCmd(ADC2, ADC_AnalogWatchdog_None);
+	ADC_ClearITPendingBit(ADC1, ADC_IT_AWD);
+	ADC_ClearITPendingBit(ADC2, ADC_IT_AWD);
+
+	/* drop the transfers that completed while idle */
+	DMA_ClearITPendingBit(DMA1_IT_GL1);
+	DMA_ITConfig(DMA1_Channel1, DMA_IT_HT | DMA_IT_TC, ENABLE);
+	return ADC_SampleRate_Configuration(rate_hz);
 }
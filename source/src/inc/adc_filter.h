@@ -0,0 +1,146 @@
+/*
+ * adc_filter.h
+ *
+ * Low-pass filters for the ADC samples, with selectable kernels:
+ * - ADC_FILTER_BLOCK: Adds 2^shift samples and outputs their average once
+ * 		per block. This has the lowest noise, but a new value is available
+ * 		only after a full block.
+ * - ADC_FILTER_MOVING_AVERAGE: The average of the last 2^shift samples with
+ * 		a running sum. It outputs on every sample.
+ * - ADC_FILTER_IIR: First order IIR y += (x - y) / 2^shift. It outputs on
+ * 		every sample and it doesn't need the window memory.
+ *
+ * The filters are fed one sample at a time from the ADC DMA interrupt.
+ * Each gang has its own filter, so the gangs can use different kernels,
+ * lengths and gains.
+ *
+ * The filters can also keep some of the extra resolution of the
+ * oversampling. With gain bits, the output is sum >> (shift - gain) instead
+ * of sum >> shift, so a 12-bit ADC gives (12 + gain)-bit values. Each extra
+ * bit needs 4x oversampling to be useful (gain <= shift / 2) and the
+ * rcp_settings.max_adc_val of the pots must be set to the widened range.
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#ifndef ADC_FILTER_H_
+#define ADC_FILTER_H_
+
+#include <stdint.h>
+
+/* Max filter length is 2^ADC_FILTER_MAX_SHIFT samples (256x) */
+#define ADC_FILTER_MAX_SHIFT	8
+/* Max moving average window is 2^ADC_FILTER_MAX_WINDOW_SHIFT samples */
+#ifndef ADC_FILTER_MAX_WINDOW_SHIFT
+#define ADC_FILTER_MAX_WINDOW_SHIFT	6
+#endif
+/* Max resolution gain, so the output fits in 16 bits with a 12-bit ADC */
+#define ADC_FILTER_MAX_GAIN		4
+
+enum en_adc_filter_type {
+	ADC_FILTER_BLOCK = 0,
+	ADC_FILTER_MOVING_AVERAGE,
+	ADC_FILTER_IIR,
+};
+
+/* The arguments that adc_filter_init() accepts */
+#define ADC_FILTER_CONFIG_VALID(TYPE, SHIFT, GAIN) ( \
+			((TYPE) <= ADC_FILTER_IIR) && ((SHIFT) <= ADC_FILTER_MAX_SHIFT) \
+			&& (((TYPE) != ADC_FILTER_MOVING_AVERAGE) || ((SHIFT) <= ADC_FILTER_MAX_WINDOW_SHIFT)) \
+			&& ((GAIN) <= ((SHIFT) >> 1)) && ((GAIN) <= ADC_FILTER_MAX_GAIN) \
+					)
+
+/**
+ * Filter state.
+ * type		: en_adc_filter_type
+ * shift	: The filter length is 2^shift samples
+ * out_shift	: shift - gain, the right shift of the output
+ * primed	: Set after the first sample, which fills the filter history
+ * out		: The last filtered value, the first sample until the first output
+ * index	: Block: samples in the sum, moving average: the oldest sample in the window
+ * sum		: Block/moving average: sum of the samples, IIR: output << shift
+ * window	: The last samples for the moving average
+ */
+struct adc_filter {
+	uint8_t		type;
+	uint8_t		shift;
+	uint8_t		out_shift;
+	uint8_t		primed;
+	uint16_t	out;
+	uint16_t	index;
+	uint32_t	sum;
+	uint16_t	window[1 << ADC_FILTER_MAX_WINDOW_SHIFT];
+};
+
+/**
+ * @brief Initialize a filter
+ * @param[in] filter The filter
+ * @param[in] type The kernel (en_adc_filter_type)
+ * @param[in] shift The filter length is 2^shift samples [0, ADC_FILTER_MAX_SHIFT],
+ * 		or [0, ADC_FILTER_MAX_WINDOW_SHIFT] for the moving average
+ * @param[in] gain The extra output bits [0, min(shift / 2, ADC_FILTER_MAX_GAIN)]
+ * @return int 0 on success, -1 on invalid arguments
+ */
+int adc_filter_init(struct adc_filter *filter, uint8_t type, uint8_t shift, uint8_t gain);
+
+/**
+ * @brief Get the rate that the filter outputs values
+ * @param[in] filter The filter
+ * @param[in] sample_rate The rate of the input samples
+ * @return uint32_t The output rate
+ */
+uint32_t adc_filter_output_rate(const struct adc_filter *filter, uint32_t sample_rate);
+
+/**
+ * @brief Get the rate of the filter windows. A step of the input takes
+ * 		a full window (2^shift samples, or the time constant for the IIR)
+ * 		to pass through the filter, so the filtered values can't follow
+ * 		faster changes, even when the filter outputs on every sample.
+ * @param[in] filter The filter
+ * @param[in] sample_rate The rate of the input samples
+ * @return uint32_t The window rate
+ */
+uint32_t adc_filter_window_rate(const struct adc_filter *filter, uint32_t sample_rate);
+
+/**
+ * @brief Add a sample to the filter
+ * @param[in] filter The filter
+ * @param[in] sample The new ADC sample
+ * @param[out] out The filtered value, when there's a new one
+ * @return uint8_t 1 if a new value was written in out, otherwise 0
+ */
+static inline uint8_t adc_filter_update(struct adc_filter *filter, uint16_t sample, uint16_t *out)
+{
+	if (!filter->primed) {
+		if (filter->type == ADC_FILTER_MOVING_AVERAGE)
+			for (int i=0; i<(1 << filter->shift); i++)
+				filter->window[i] = sample;
+		filter->sum = (filter->type == ADC_FILTER_BLOCK) ? 0 : (uint32_t) sample << filter->shift;
+		filter->out = sample << (filter->shift - filter->out_shift);
+		filter->primed = 1;
+	}
+
+	switch (filter->type) {
+	case ADC_FILTER_MOVING_AVERAGE:
+		/* replace the oldest sample in the sum */
+		filter->sum += sample - filter->window[filter->index];
+		filter->window[filter->index] = sample;
+		filter->index = (filter->index + 1) & ((1 << filter->shift) - 1);
+		*out = filter->out = filter->sum >> filter->out_shift;
+		return 1;
+	case ADC_FILTER_IIR:
+		filter->sum += sample - (filter->sum >> filter->shift);
+		*out = filter->out = filter->sum >> filter->out_shift;
+		return 1;
+	default:
+		filter->sum += sample;
+		if ((++filter->index) < (1 << filter->shift))
+			return 0;
+		*out = filter->out = filter->sum >> filter->out_shift;
+		filter->sum = 0;
+		filter->index = 0;
+		return 1;
+	}
+}
+
+#endif /* ADC_FILTER_H_ */
@@ -0,0 +1,67 @@
+/*
+ * adc_rate.h
+ *
+ * Hysteretic controller for the ADC sample rate. It counts the accepted
+ * pot steps and switches to the high rate as soon as there are up_steps
+ * steps in a window, and back to the low rate when there are less than
+ * down_steps steps for timeout_windows windows in a row. The controller
+ * only decides the mode, the caller applies the rate.
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#ifndef ADC_RATE_H_
+#define ADC_RATE_H_
+
+#include <stdint.h>
+
+enum en_adc_rate_mode {
+	ADC_RATE_LOW = 0,
+	ADC_RATE_HIGH,
+};
+
+/**
+ * Rate controller.
+ * up_steps			: Accepted steps in a window to switch to the high rate
+ * down_steps		: A window with less steps than this is quiet
+ * timeout_windows	: Quiet windows to switch to the low rate
+ * mode				: en_adc_rate_mode
+ * steps			: Accepted steps in the current window
+ * quiet_windows	: Quiet windows in a row
+ * switches			: Number of mode changes
+ */
+struct adc_rate_ctrl {
+	uint16_t	up_steps;
+	uint16_t	down_steps;
+	uint16_t	timeout_windows;
+	uint8_t		mode;
+	uint16_t	steps;
+	uint16_t	quiet_windows;
+	uint32_t	switches;
+};
+
+/**
+ * @brief Initialize the controller in the high rate mode
+ * @return int 0 on success, -1 if up_steps < down_steps (no hysteresis)
+ */
+int adc_rate_init(struct adc_rate_ctrl *ctrl, uint16_t up_steps, uint16_t down_steps,
+		uint16_t timeout_windows);
+
+/**
+ * @brief Add accepted steps. Call this after the pots are decoded.
+ * @return uint8_t 1 if the mode changed to the high rate, otherwise 0
+ */
+uint8_t adc_rate_add_steps(struct adc_rate_ctrl *ctrl, uint32_t steps);
+
+/**
+ * @brief Close the current window. Call this periodically.
+ * @return uint8_t 1 if the mode changed to the low rate, otherwise 0
+ */
+uint8_t adc_rate_window(struct adc_rate_ctrl *ctrl);
+
+/**
+ * @brief Force a mode, e.g. the high rate after a wake up
+ */
+void adc_rate_set_mode(struct adc_rate_ctrl *ctrl, uint8_t mode);
+
+#endif /* ADC_RATE_H_ */
@@ -0,0 +1,44 @@
+/*
+ * bench.h
+ *
+ * Cycle count benchmarks that run on the target. The cycles are measured
+ * with the DWT cycle counter of the Cortex-M3, so the results include the
+ * flash wait states and are the real cost on the MCU.
+ *
+ * To run the benchmarks, enable BENCHMARK in platform_config.h and the
+ * results will be printed in the debug uart after boot.
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdint.h>
+#include "stm32f10x.h"
+
+/**
+ * @brief Enable the DWT cycle counter
+ */
+static inline void bench_init(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/**
+ * @brief Get the current value of the cycle counter
+ * @return uint32_t The number of CPU cycles
+ */
+static inline uint32_t bench_cycles(void)
+{
+	return DWT->CYCCNT;
+}
+
+/**
+ * @brief Run all the benchmarks and print the results
+ */
+void bench_run(void);
+
+#endif /* BENCH_H_ */
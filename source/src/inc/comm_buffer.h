@@ -3,6 +3,15 @@
  *
  *  Created on: 10 May 2018
  *      Author: Dimitris Tassopoulos
+ *
+ * The TX buffer is a single producer/single consumer ring. The producer is
+ * the main thread and the consumer is the UART interrupt (or DMA), so the
+ * ring is lock-free:
+ * 	- The size is a power of two and the index is masked into the buffer
+ * 	- tx_ptr_in and tx_ptr_out are free-running (they are never reset) and
+ * 		tx_ptr_in - tx_ptr_out is the number of used bytes
+ * 	- Each side only writes its own index and a memory barrier orders the
+ * 		data accesses before it publishes the index
  */
 
 #ifndef COMM_BUFFER_H_
@@ -10,6 +19,15 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
+
+/* Memory barrier between the ring data and the ring indexes */
+#ifndef COMM_BUFFER_BARRIER
+#define COMM_BUFFER_BARRIER() __DMB()
+#endif
+
+/* The ring sizes must be powers of two, up to 32 KB */
+#define COMM_BUFFER_SIZE_VALID(SIZE) ((SIZE) && ((SIZE) <= 0x8000) && !((SIZE) & ((SIZE) - 1)))
 
 /**
  * @brief This is a struct that is used for UART comms
@@ -22,14 +40,13 @@ struct tp_comm_buffer {
 	uint8_t 	tx_ready;
 	uint16_t 	tx_ptr_in;
 	uint16_t 	tx_ptr_out;
-	uint16_t 	tx_length;
-	uint8_t  	tx_int_en;
+	volatile uint8_t  	tx_int_en;
 	/* rx vars */
 	uint8_t 	*rx_buffer;
 	size_t		rx_buffer_size;
-	uint8_t 	rx_ready;
+	volatile uint8_t 	rx_ready;
 	uint8_t		rx_ready_tmr;
-	uint16_t	rx_ptr_in;
+	volatile uint16_t	rx_ptr_in;
 	uint16_t	rx_ptr_out;
 	uint16_t 	rx_length;
 };
@@ -37,10 +54,118 @@ struct tp_comm_buffer {
 #define DECLARE_COMM_BUFFER(NAME, TX_SIZE, RX_SIZE) \
 	uint8_t comm_tx_buffer_##NAME[TX_SIZE]; \
 	uint8_t comm_rx_buffer_##NAME[RX_SIZE]; \
-	volatile struct tp_comm_buffer NAME = { \
+	struct tp_comm_buffer NAME = { \
 		.tx_buffer = comm_tx_buffer_##NAME, \
 		.tx_buffer_size = TX_SIZE, \
 		.rx_buffer = comm_rx_buffer_##NAME, \
 		.rx_buffer_size = RX_SIZE \
 	}
+
+/**
+ * @brief Get the bytes in the TX ring
+ * @param[in] buff The comm buffer
+ * @return uint16_t The used bytes
+ */
+static inline uint16_t comm_buffer_tx_used(struct tp_comm_buffer *buff)
+{
+	COMM_BUFFER_BARRIER();
+	return (uint16_t) (buff->tx_ptr_in - buff->tx_ptr_out);
+}
+
+/**
+ * @brief Get the free space in the TX ring
+ * @param[in] buff The comm buffer
+ * @return uint16_t The free bytes
+ */
+static inline uint16_t comm_buffer_tx_free(struct tp_comm_buffer *buff)
+{
+	return buff->tx_buffer_size - comm_buffer_tx_used(buff);
+}
+
+/**
+ * @brief Add data to the TX ring (producer)
+ * @param[in] buff The comm buffer
+ * @param[in] data The data
+ * @param[in] len The data length
+ * @return uint16_t The bytes that were added, less than len if the ring is full
+ */
+static inline uint16_t comm_buffer_tx_write(struct tp_comm_buffer *buff, const uint8_t *data, uint16_t len)
+{
+	uint16_t mask = buff->tx_buffer_size - 1;
+	uint16_t in = buff->tx_ptr_in;
+	uint16_t free = comm_buffer_tx_free(buff);
+
+	if (len > free)
+		len = free;
+	if (!len)
+		return 0;
+
+	uint16_t index = in & mask;
+	uint16_t span = buff->tx_buffer_size - index;
+	if (span > len)
+		span = len;
+	memcpy(&buff->tx_buffer[index], data, span);
+	memcpy(buff->tx_buffer, &data[span], len - span);
+
+	/* the data must be written before the consumer sees them */
+	COMM_BUFFER_BARRIER();
+	buff->tx_ptr_in = in + len;
+
+	return len;
+}
+
+/**
+ * @brief Get the contiguous data at the start of the TX ring (consumer),
+ * 		without removing them. It's used to send the ring with DMA.
+ * @param[in] buff The comm buffer
+ * @param[out] data The start of the data
+ * @return uint16_t The contiguous bytes, up to the end of the ring buffer
+ */
+static inline uint16_t comm_buffer_tx_span(struct tp_comm_buffer *buff, uint8_t **data)
+{
+	uint16_t used = comm_buffer_tx_used(buff);
+	uint16_t index = buff->tx_ptr_out & (buff->tx_buffer_size - 1);
+	uint16_t span = buff->tx_buffer_size - index;
+
+	*data = &buff->tx_buffer[index];
+	return (used < span) ? used : span;
+}
+
+/**
+ * @brief Remove data from the TX ring (consumer), after they are sent
+ * @param[in] buff The comm buffer
+ * @param[in] len The bytes to remove, up to comm_buffer_tx_used()
+ */
+static inline void comm_buffer_tx_consume(struct tp_comm_buffer *buff, uint16_t len)
+{
+	/* the data must be read before the producer overwrites them */
+	COMM_BUFFER_BARRIER();
+	buff->tx_ptr_out += len;
+}
+
+/**
+ * @brief Copy and remove data from the TX ring (consumer)
+ * @param[in] buff The comm buffer
+ * @param[out] data The output buffer
+ * @param[in] len The output buffer length
+ * @return uint16_t The bytes that were copied
+ */
+static inline uint16_t comm_buffer_tx_read(struct tp_comm_buffer *buff, uint8_t *data, uint16_t len)
+{
+	uint16_t copied = 0;
+
+	for (int i=0; (i < 2) && (copied < len); i++) {
+		uint8_t *span_data;
+		uint16_t span = comm_buffer_tx_span(buff, &span_data);
+		if (!span)
+			break;
+		if (span > (len - copied))
+			span = len - copied;
+		memcpy(&data[copied], span_data, span);
+		comm_buffer_tx_consume(buff, span);
+		copied += span;
+	}
+	return copied;
+}
+
 #endif /* COMM_BUFFER_H_ */
@@ -15,6 +15,33 @@
  *
  * Add this function in the interrupt handler of the used UART port
  * 		debug_uart_irq()
+ *
+ * With the DEV_UART_DMA_TX flag the TX ring is sent with DMA (DMA1 channel 4
+ * for USART1, channel 7 for USART2) instead of one TXE interrupt per byte.
+ * Each transfer sends the contiguous span of the ring up to its end and the
+ * transfer complete interrupt chains the next span after a wrap-around.
+ *
+ * With the DEV_UART_DMA_RX flag the RX buffer is a circular DMA buffer (DMA1
+ * channel 5 for USART1, channel 6 for USART2) and there are no per-byte
+ * interrupts. The USART idle line interrupt marks the end of a frame and the
+ * next dev_uart_update() hands it to the callback, without the timeout_ms
+ * delay. In this mode dev_uart_update() can be called on every main loop.
+ * The DMA half/complete transfer interrupts count the received bytes, so
+ * when more than BUFFER_SIZE bytes arrive before a frame is copied for the
+ * callback, the DMA has overwritten it and it's counted in rx_discards instead.
+ *
+ * The TX buffer is a lock-free ring (see comm_buffer.h), so BUFFER_SIZE must
+ * be a power of two.
+ *
+ * RX and TX are independent (full-duplex), so the host can send while the
+ * firmware streams data.
+ *
+ * When the TX ring is full, the tx_policy of the device drops the new bytes
+ * (default), drops the oldest bytes of the ring, or blocks for up to
+ * tx_timeout_ms. Blocking needs a ms time base from the application and is
+ * only done in thread mode with the interrupts enabled, otherwise the new
+ * bytes are dropped. The dropped bytes and the
+ * buffer usage are counted in struct dev_uart_stats.
  */
 
 #ifndef DEV_UART_H_
@@ -26,7 +53,42 @@
 #include "stm32f10x.h"
 #include "comm_buffer.h"
 
-#define DECLARE_UART_DEV(NAME, PORT, BAUDRATE, BUFFER_SIZE, TIMEOUT_MS, DEBUG) \
+/**
+ * @brief Device flags
+ */
+enum en_dev_uart_flags {
+	DEV_UART_DMA_TX = (1 << 0),
+	DEV_UART_DMA_RX = (1 << 1),
+};
+
+/**
+ * @brief What to do when the TX ring is full
+ */
+enum en_dev_uart_tx_policy {
+	DEV_UART_TX_DROP_NEWEST = 0,
+	DEV_UART_TX_DROP_OLDEST,
+	DEV_UART_TX_BLOCK,
+};
+
+/**
+ * Device counters.
+ * tx_dropped		: TX bytes that were dropped, because the ring was full
+ * rx_discards		: RX bytes that were discarded, because the buffer was full
+ * rx_overruns		: USART overrun errors, when a byte arrives before the previous is read
+ * tx_high_water	: Max used bytes of the TX ring
+ * rx_high_water	: Max received bytes that were waiting for the callback
+ */
+struct dev_uart_stats {
+	uint32_t	tx_dropped;
+	uint32_t	rx_discards;
+	uint32_t	rx_overruns;
+	uint16_t	tx_high_water;
+	uint16_t	rx_high_water;
+};
+
+/* The linear copy of the DMA RX frames is only needed with DEV_UART_DMA_RX */
+#define DECLARE_UART_DEV(NAME, PORT, BAUDRATE, BUFFER_SIZE, TIMEOUT_MS, DEBUG, FLAGS) \
+	static uint8_t NAME##_rx_frame[((FLAGS) & DEV_UART_DMA_RX) ? (BUFFER_SIZE) : 1]; \
 	struct dev_uart NAME = { \
 		.port = PORT, \
 		.config = { \
@@ -43,6 +105,8 @@
 		}, \
 		.timeout_ms = TIMEOUT_MS, \
 		.debug = DEBUG, \
+		.flags = FLAGS, \
+		.rx_frame = NAME##_rx_frame, \
 		.fp_dev_uart_cb = NULL, \
 	}
 
@@ -53,6 +117,12 @@
  */
 typedef void (*dev_uart_cb)(uint8_t *buffer, size_t bufferlen, uint8_t sender);
 
+/**
+ * @brief Time base of the blocking TX timeout
+ * @return uint32_t A free running ms counter
+ */
+typedef uint32_t (*dev_uart_time_cb)(void);
+
 struct dev_uart {
 	USART_TypeDef*		port;
 	USART_InitTypeDef	config;
@@ -60,7 +130,26 @@ struct dev_uart {
 	uint8_t				debug;
 	uint8_t				timeout_ms;
 	uint8_t				available;
-	volatile struct tp_comm_buffer uart_buff;
+	uint8_t				flags;
+	uint8_t				tx_policy;
+	uint16_t			tx_timeout_ms;
+	dev_uart_time_cb	fp_time_ms;
+	/* DMA TX channel, its transfer complete flag and the bytes in flight */
+	DMA_Channel_TypeDef	*tx_dma;
+	uint32_t			tx_dma_tc;
+	volatile uint16_t	tx_dma_len;
+	/* DMA RX channel and the linear copy of the frames for the callback */
+	DMA_Channel_TypeDef	*rx_dma;
+	uint8_t				*rx_frame;
+	/* The DMA RX interrupt flags, the last DMA write position, the received
+	 * bytes, the received bytes until the last idle line and the handled bytes */
+	uint32_t			rx_dma_it;
+	uint16_t			rx_dma_pos;
+	uint32_t			rx_dma_received;
+	volatile uint32_t	rx_dma_frame_end;
+	volatile uint32_t	rx_dma_handled;
+	volatile struct dev_uart_stats stats;
+	struct tp_comm_buffer uart_buff;
 	/**
 	* @brief Callback function definition for reception
 	* @param[in] buffer Pointer to the RX buffer
@@ -109,10 +198,28 @@ int dev_uart_receive(struct dev_uart * dev);
 
 void dev_uart_set_baud_rate(struct dev_uart * dev, uint32_t baudrate);
 
+/**
+ * @brief Set what to do when the TX ring is full
+ * @param[in] dev_uart A pointer to the UART device
+ * @param[in] policy The policy (en_dev_uart_tx_policy)
+ * @param[in] timeout_ms The max time to block with DEV_UART_TX_BLOCK
+ * @param[in] time_ms The ms time base, required for DEV_UART_TX_BLOCK
+ */
+void dev_uart_set_tx_policy(struct dev_uart * dev, uint8_t policy, uint16_t timeout_ms,
+		dev_uart_time_cb time_ms);
+
+/**
+ * @brief Get the device counters
+ * @param[in] dev_uart A pointer to the UART device
+ * @param[out] stats The counters
+ */
+void dev_uart_get_stats(struct dev_uart * dev, struct dev_uart_stats * stats);
+
 
 /**
  * @brief Poll the RX buffer for new data. If new data are found then
- * 		the fp_debug_uart_cb will be called.
+ * 		the fp_debug_uart_cb will be called. It must be called every 1 ms,
+ * 		or as often as possible with DEV_UART_DMA_RX.
  * @param[in] dev_uart A pointer to the UART device
  */
 void dev_uart_update(struct dev_uart * uart);
@@ -41,6 +41,9 @@ void NVIC_Configuration(void);
 void RCC_Configuration(void);
 void GPIO_Configuration(void);
 void ADC_Configuration(void);
+uint32_t ADC_SampleRate_Configuration(uint32_t rate_hz);
+void ADC_Idle_Configuration(uint16_t adc1_val, uint16_t adc2_val, uint16_t margin, uint32_t rate_hz);
+uint32_t ADC_Active_Configuration(uint32_t rate_hz);
 
 /* External variables --------------------------------------------------------*/
 
@@ -13,6 +13,8 @@
 #include <stddef.h>
 #include "stm32f10x.h"
 #include "dev_uart.h"
+#include "adc_filter.h"
+#include "adc_rate.h"
 
 /**
  * Trace levels for this project.
@@ -21,10 +23,19 @@
 typedef enum {
 	TRACE_LEVEL_DEFAULT = 	(1 << 0),
 	TRACE_LEVEL_ADC = 	(1 << 1),
+	TRACE_LEVEL_LATENCY = 	(1 << 2),
+	TRACE_LEVEL_UART = 	(1 << 3),
 } en_trace_level;
 
 #define DEBUG_TRACE
 
+/* Enable to run the cycle benchmarks (bench.c) on boot */
+//#define BENCHMARK
+
+/* Enable to decode the pots in the ADC interrupt, right after the
+ * averaging, instead of the main loop. */
+//#define RCP_DECODE_IN_ISR
+
 #ifdef DEBUG_TRACE
 #define TRACE(X) TRACEL(TRACE_LEVEL_DEFAULT, X)
 #define TRACEL(TRACE_LEVEL, X) do { if (glb.trace_levels & TRACE_LEVEL) printf X;} while(0)
@@ -48,25 +59,145 @@ enum {
 #define PIN_STATUS_LED 		GPIO_Pin_13
 #define PORT_STATUS_LED 	GPIOC
 
+/* ADC DMA buffer. Each half of the buffer is filtered on every half/full
+ * transfer interrupt.
+ */
+#define ADC_DMA_BUFFER_SIZE	32
+
+/* ADC pairs per second, triggered by TIM3 */
+#define ADC_SAMPLE_RATE_HZ	32000
+
+/* Sample rate controller. The ADCs sample at ADC_SAMPLE_RATE_HZ while the
+ * pots move and at ADC_LOW_SAMPLE_RATE_HZ after ADC_RATE_TIMEOUT_WINDOWS
+ * windows of ADC_RATE_WINDOW_MS with less than ADC_RATE_DOWN_STEPS accepted
+ * steps. ADC_RATE_UP_STEPS steps in a window switch back to the high rate. */
+#define ADC_LOW_SAMPLE_RATE_HZ		4000
+#define ADC_RATE_WINDOW_MS			100
+#define ADC_RATE_UP_STEPS			2
+#define ADC_RATE_DOWN_STEPS			1
+#define ADC_RATE_TIMEOUT_WINDOWS	10
+
+/* ADC filter kernel (en_adc_filter_type) and length (2^ADC_FILTER_SHIFT,
+ * 4x to 256x). The default block average of 32 samples decodes the pots at
+ * 1 kHz. ADC_FILTER_GAIN keeps extra bits of the oversampling, so the pots
+ * get (ADC_BITS + ADC_FILTER_GAIN)-bit values (up to 16, gain <= shift / 2).
+ * Each gang has its own filter and ADC1_FILTER_* and ADC2_FILTER_* override
+ * the settings of one gang. */
+#define ADC_FILTER_TYPE		ADC_FILTER_BLOCK
+#define ADC_FILTER_SHIFT	5
+#define ADC_FILTER_GAIN		0
+
+#define ADC1_FILTER_TYPE	ADC_FILTER_TYPE
+#define ADC1_FILTER_SHIFT	ADC_FILTER_SHIFT
+#define ADC1_FILTER_GAIN	ADC_FILTER_GAIN
+#define ADC2_FILTER_TYPE	ADC_FILTER_TYPE
+#define ADC2_FILTER_SHIFT	ADC_FILTER_SHIFT
+#define ADC2_FILTER_GAIN	ADC_FILTER_GAIN
+
+#define ADC_BITS			12
+/* Max value of the filtered ADC samples of each gang */
+#define ADC1_FILTERED_MAX	((1 << (ADC_BITS + ADC1_FILTER_GAIN)) - 1)
+#define ADC2_FILTERED_MAX	((1 << (ADC_BITS + ADC2_FILTER_GAIN)) - 1)
+
+/* Idle mode. After IDLE_TIMEOUT_MS without pot changes, the ADCs sample at
+ * ADC_IDLE_SAMPLE_RATE_HZ without decoding and the core sleeps with WFI,
+ * until the analog watchdog detects that a gang moved more than
+ * ADC_IDLE_AWD_MARGIN from its last value. */
+#define IDLE_MODE
+#define IDLE_TIMEOUT_MS			2000
+#define ADC_IDLE_SAMPLE_RATE_HZ	200
+#define ADC_IDLE_AWD_MARGIN		64
+
 struct tp_glb {
 	volatile uint16_t tmr_1ms;
 	volatile uint16_t tmr_1000ms;
+	volatile uint32_t ticks_ms;	// free running ms counter
 	en_trace_level trace_levels;
 
-	/* ADC values */
-	volatile uint32_t 	adc1_temp;
+	/* ADC values. The low half-word of each DMA word is ADC1 and the
+	 * high is ADC2, which are sampled at the same time. */
+	volatile uint32_t	adc_dma_buffer[ADC_DMA_BUFFER_SIZE];
+	struct adc_filter	adc_filter[2];
+	/* The last filtered pair. It's published by the DMA interrupt with a
+	 * sequence number (seqlock), which is odd while the pair is written.
+	 * Use adc_pair_publish() and adc_pair_read(). */
+	volatile uint32_t	adc_seq;
 	volatile uint16_t 	adc1_val;
-	volatile uint8_t	adc1_counter;
-	volatile uint8_t	adc1_ready;
-
-	volatile uint32_t 	adc2_temp;
 	volatile uint16_t 	adc2_val;
-	volatile uint8_t	adc2_counter;
-	volatile uint8_t	adc2_ready;
+	uint32_t			adc_seq_read;		// sequence of the last pair that was decoded
+	uint32_t			adc_overruns;		// pairs overwritten before they were decoded
+	uint32_t			adc_sample_rate;	// actual rate in Hz
+	struct adc_rate_ctrl	adc_rate;		// adc_rate.mode is the current rate mode
+	volatile uint32_t	rcp_accepted;		// decoded samples out of the dead-zone
+
+	/* Latency from the last ADC average to the pot update in CPU cycles */
+	volatile uint32_t	adc_ready_cycles;
+	volatile uint32_t	rcp_latency;
+	volatile uint32_t	rcp_latency_max;
+
+	/* Idle mode */
+	volatile uint8_t	idle;
+	volatile uint32_t	wake_cycles;	// when the analog watchdog fired
+	volatile uint32_t	wake_latency;	// cycles from the watchdog to the first pot update
+	volatile uint32_t	last_activity_ms;
 };
 
 extern struct tp_glb glb;
 
+/**
+ * @brief Publish a new ADC pair. Only the DMA interrupt writes the pair,
+ * 		so this never waits.
+ */
+static inline void adc_pair_publish(uint16_t adc1_val, uint16_t adc2_val)
+{
+	glb.adc_seq++;
+	__DMB();
+	glb.adc1_val = adc1_val;
+	glb.adc2_val = adc2_val;
+	__DMB();
+	glb.adc_seq++;
+}
+
+/**
+ * @brief Read the last ADC pair. The read is repeated if the pair was
+ * 		written in the meantime, so both values are from the same window.
+ * @param[out] adc1_val The first gang
+ * @param[out] adc2_val The second gang
+ * @return uint32_t The sequence number of the pair (+2 for each new pair)
+ */
+static inline uint32_t adc_pair_read(uint16_t *adc1_val, uint16_t *adc2_val)
+{
+	uint32_t seq;
+
+	do {
+		seq = glb.adc_seq;
+		__DMB();
+		*adc1_val = glb.adc1_val;
+		*adc2_val = glb.adc2_val;
+		__DMB();
+	} while ((seq & 1) || (seq != glb.adc_seq));
+
+	return seq;
+}
+
+/**
+ * @brief Update the latency after the pots are updated with the ADC values.
+ * 		This needs the DWT cycle counter (bench_init())
+ */
+static inline void update_rcp_latency(void)
+{
+	uint32_t now = DWT->CYCCNT;
+
+	glb.rcp_latency = now - glb.adc_ready_cycles;
+	if (glb.rcp_latency > glb.rcp_latency_max)
+		glb.rcp_latency_max = glb.rcp_latency;
+	/* first update after the wake up from idle */
+	if (glb.wake_cycles) {
+		glb.wake_latency = now - glb.wake_cycles;
+		glb.wake_cycles = 0;
+	}
+}
+
 static inline void set_trace_level(en_trace_level level, uint8_t enable)
 {
 	if (enable) {
@@ -5,10 +5,15 @@
  * dual gang pots with 90 degree phase between the two gangs.
  *
  * - Supports ADCs with different bits
- * - Supports floats or uint16_t in systems that don't support floats
+ * - Supports floats, Q16.16 fixed point or uint16_t values
  * - Supports individual dead-zones for each pot gang
  * - Support negative ranges
  * - Supports float steps
+ * - Supports absolute angle inside the waveform period (rcp_get_angle)
+ * - Supports compile time specialised pots in C++ (rotary_cont_pot.hpp)
+ * - Supports velocity based step acceleration (rcp_set_accel)
+ * - Supports unclamped multi-turn position and revolutions (rcp_get_position)
+ * - Supports a lock-free queue with the value changes (rcp_get_events)
  *
  * Notes:
  * When updating the pots with the ADC values, make sure that the ADCs are low
@@ -79,8 +84,8 @@
  * pot supports an individual step, which also can be integer of float.
  *
  * Therefore, the pot API provides individual range, min, max, step and dead-zone
- * values and you can use any number of pots as long you initialize the proper
- * size in the init function.
+ * values and you can use any number of pots as long you declare the proper
+ * size with DECLARE_RCP_BANK() and pass the bank to the init function.
  *
  *  Created on: Jul 5, 2018
  *      Author: Dimitris Tassopoulos
@@ -93,26 +98,53 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include "platform_config.h"
+#include "rotary_cont_pot_decode.h"
 
-/* In MCUs that doesn't support hard float then,
- * you can disable floats for performance
- */
-#define RCP_SUPPORT_FLOATS
+/* Time base for the acceleration in ms. Override it to use a finer timer */
+#ifndef RCP_GET_TIME_MS
+#define RCP_GET_TIME_MS() (glb.ticks_ms)
+#endif
+
+/* Max step multiplier for the acceleration */
+#define RCP_ACCEL_MAX_MULT	32
+
+/* Quadrants in a full period of the gangs waveforms (a full turn) */
+#define RCP_QUARTERS_PER_REV	4
+
+/* Size of the event queue. Must be a power of 2 */
+#ifndef RCP_EVENT_QUEUE_SIZE
+#define RCP_EVENT_QUEUE_SIZE	32
+#endif
+
+/* Memory barrier between the event data and the queue indexes */
+#ifndef RCP_MEMORY_BARRIER
+#define RCP_MEMORY_BARRIER() __DMB()
+#endif
 
-#ifdef RCP_SUPPORT_FLOATS
-typedef float tp_rcp_val;
+/* When the decoder runs in an interrupt, the state that is larger than a
+ * word or is written by both contexts is accessed with the interrupts masked.
+ * The ticks are a single word, so the value is published atomically anyway.
+ */
+#ifdef RCP_DECODE_IN_ISR
+#define RCP_ENTER_CRITICAL() uint32_t rcp_primask = __get_PRIMASK(); __disable_irq()
+#define RCP_EXIT_CRITICAL() __set_PRIMASK(rcp_primask)
 #else
-typedef uint16_t tp_rcp_val;
+#define RCP_ENTER_CRITICAL()
+#define RCP_EXIT_CRITICAL()
 #endif
 
 /**
  * static declaration for pot settings. Just a shortcut
  */
 #define DECLARE_RCP_ADC(NAME,MIN_ADC_VAL,MAX_ADC_VAL,DEAD_ZONE) \
+	DECLARE_RCP_ADC_HYST(NAME,MIN_ADC_VAL,MAX_ADC_VAL,DEAD_ZONE,0)
+
+#define DECLARE_RCP_ADC_HYST(NAME,MIN_ADC_VAL,MAX_ADC_VAL,DEAD_ZONE,HYSTERESIS) \
 	struct rcp_settings NAME = { \
 		.min_adc_val = MIN_ADC_VAL, \
 		.max_adc_val = MAX_ADC_VAL, \
 		.dead_zone = DEAD_ZONE, \
+		.hysteresis = HYSTERESIS, \
 	}
 
 /**
@@ -124,26 +156,143 @@ typedef uint16_t tp_rcp_val;
  * @param[in] dead_zone In case there's noise on the ADC use this to create dead zones
  * 					Usually prefer that not to be 0, but >10. The larger the zone
  * 					The more turns you need with the pot.
+ * @param[in] hysteresis Half width of the band around the ADC midpoint that the
+ * 					gang must cross to change quadrant. This stops the quadrant
+ * 					from chattering with the ADC noise, so a smaller dead_zone
+ * 					can be used. Set it a bit higher than the ADC noise.
  */
 struct rcp_settings {
 	uint16_t	min_adc_val;	// usually: 0
 	uint16_t	max_adc_val;	// usually: (1 << adc_bits) - 1
 	uint8_t		dead_zone;
+	uint8_t		hysteresis;		// usually: 0 or the ADC noise
+};
+
+/**
+ * Pot configuration. This is set in rcp_add() and it's only read
+ * by the decoder. The start value and the tick limits change only
+ * with rcp_set_value().
+ * min				: That's the the min value that the pot can take.
+ * max				: That's the max value of the pot
+ * step				: The value change on every accepted ADC sample
+ * start			: The value of the pot when its ticks are 0
+ * tick_min			: The ticks that are needed to get from start to min (<= 0)
+ * tick_max			: The ticks that are needed to get from start to max (>= 0)
+ * adc_half			: The precomputed midpoint of each gang
+ * adc_inv_span		: (1 << 30) / (half of the gang's ADC range)
+ * accel_threshold_ms	: The time between quadrants below which the step is multiplied
+ * accel_max		: The max step multiplier (1 means no acceleration)
+ */
+struct rcp_pot_config {
+	tp_rcp_val		min;
+	tp_rcp_val		max;
+	tp_rcp_val		step;
+	tp_rcp_val		start;
+	int32_t			tick_min;
+	int32_t			tick_max;
+	uint16_t		adc_half[2];
+	uint32_t		adc_inv_span[2];
+	uint16_t		accel_threshold_ms;
+	uint8_t			accel_max;
+	struct rcp_settings settings[2];
+};
+
+/**
+ * Static bank of pots in struct-of-arrays layout. The decoder state that
+ * changes on every sample is kept in separate arrays per field, so the
+ * same field of all the pots is contiguous, and the configuration is kept
+ * in a separate array. Use DECLARE_RCP_BANK() to declare it.
+ * The pot value is not stored, but only the signed number of steps (ticks)
+ * from the start value, and the value is calculated in rcp_get_value().
+ */
+struct rcp_bank {
+	uint8_t			size;
+	uint8_t			used;
+	/* hot decoder state */
+	int32_t			*ticks;		// steps from the start value
+	int64_t			*position;	// unclamped position in quadrants
+	uint8_t			*quarter;
+	int8_t			*last_dir;	// direction of the last step
+	uint16_t		*adc1;		// last accepted ADC1 value
+	uint16_t		*adc2;		// last accepted ADC2 value
+	uint16_t		*last_adc1;	// last ADC1 sample, even if it was in the dead-zone
+	uint16_t		*last_adc2;	// last ADC2 sample, even if it was in the dead-zone
+	uint32_t		*trans_ms;	// time of the last quadrant transition
+	uint8_t			*accel;		// current step multiplier
+	/* statistics */
+	uint32_t		*skipped;	// number of skipped quadrants
+	/* cold configuration */
+	struct rcp_pot_config *config;
+};
+
+/**
+ * Static declaration of a pot bank with NUM_OF_POTS pots. All the memory
+ * is allocated at compile time, so it's accounted by the linker.
+ */
+#define DECLARE_RCP_BANK(NAME, NUM_OF_POTS) \
+	_Static_assert((NUM_OF_POTS) > 0 && (NUM_OF_POTS) <= 255, "invalid number of pots"); \
+	int32_t rcp_ticks_##NAME[NUM_OF_POTS]; \
+	int64_t rcp_position_##NAME[NUM_OF_POTS]; \
+	uint8_t rcp_quarter_##NAME[NUM_OF_POTS]; \
+	int8_t rcp_last_dir_##NAME[NUM_OF_POTS]; \
+	uint16_t rcp_adc1_##NAME[NUM_OF_POTS]; \
+	uint16_t rcp_adc2_##NAME[NUM_OF_POTS]; \
+	uint16_t rcp_last_adc1_##NAME[NUM_OF_POTS]; \
+	uint16_t rcp_last_adc2_##NAME[NUM_OF_POTS]; \
+	uint32_t rcp_trans_ms_##NAME[NUM_OF_POTS]; \
+	uint8_t rcp_accel_##NAME[NUM_OF_POTS]; \
+	uint32_t rcp_skipped_##NAME[NUM_OF_POTS]; \
+	struct rcp_pot_config rcp_config_##NAME[NUM_OF_POTS]; \
+	struct rcp_bank NAME = { \
+		.size = NUM_OF_POTS, \
+		.ticks = rcp_ticks_##NAME, \
+		.position = rcp_position_##NAME, \
+		.quarter = rcp_quarter_##NAME, \
+		.last_dir = rcp_last_dir_##NAME, \
+		.adc1 = rcp_adc1_##NAME, \
+		.adc2 = rcp_adc2_##NAME, \
+		.last_adc1 = rcp_last_adc1_##NAME, \
+		.last_adc2 = rcp_last_adc2_##NAME, \
+		.trans_ms = rcp_trans_ms_##NAME, \
+		.accel = rcp_accel_##NAME, \
+		.skipped = rcp_skipped_##NAME, \
+		.config = rcp_config_##NAME, \
+	}
+
+/**
+ * A change of a pot value.
+ * pot			: The index of the pot
+ * direction	: +1 when the pot was turned right, -1 when turned left
+ * delta		: The number of steps that the value changed (with the sign)
+ * timestamp	: RCP_GET_TIME_MS() when the value changed
+ */
+struct rcp_event {
+	uint8_t		pot;
+	int8_t		direction;
+	int16_t		delta;
+	uint32_t	timestamp;
 };
 
 /**
  * @brief Initializes the pots
- * @param[in] num_of_pots The number of pots you need
+ * @param[in] bank The pot bank declared with DECLARE_RCP_BANK()
  */
-int rcp_init(uint8_t num_of_pots);
+int rcp_init(struct rcp_bank *bank);
+
+/**
+ * @brief Detach the bank of the pots and clear the event queue, so
+ * 		rcp_init() can be called again with another bank
+ */
+void rcp_deinit(void);
 
 /**
  * @brief Add a new pot. Each pot has two gangs and needs two ADCs.
  * @param[in] adc1_val This is the initial value of the ADC1
  * @param[in] adc2_val This is the initial value of the ADC2
- * @param[in] start_value The initial value of the pot
+ * @param[in] start_value The initial value of the pot (clamped in [min, max])
  * @param[in] min The min value the pot can be set
  * @param[in] max The max value the pot can be set
+ * @param[in] step The value change on every step (> 0)
  * @param[in] adc1_settings Settings for the first gang pot
  * @param[in] adc2_settings Settings for the second gang pot
  */
@@ -151,6 +300,20 @@ int rcp_add(uint16_t adc1_val, uint16_t adc2_val, tp_rcp_val start_value,
 		tp_rcp_val min, tp_rcp_val max, tp_rcp_val step,
 		struct rcp_settings *adc1_settings, struct rcp_settings *adc2_settings);
 
+/**
+ * @brief Enable the step acceleration of a pot. The velocity is estimated
+ * 		from the time between the quadrant transitions and when a quadrant
+ * 		takes less than threshold_ms, the step is multiplied by
+ * 		threshold_ms / interval, up to max_mult. When the pot turns slowly
+ * 		the step is not affected, so the fine adjustment is kept.
+ * 		The time base is RCP_GET_TIME_MS() (1 ms SysTick by default).
+ * @param[in] index The pot index
+ * @param[in] threshold_ms The quadrant interval that the acceleration starts
+ * @param[in] max_mult The max step multiplier [1, RCP_ACCEL_MAX_MULT]. Use 1 to disable
+ * @return int 0 on success, -1 on error
+ */
+int rcp_set_accel(uint8_t index, uint16_t threshold_ms, uint8_t max_mult);
+
 /**
  * @brief Update the internal ADCs values and calculate the new pot value
  * @param[in] index The index of the pot
@@ -160,7 +323,100 @@ int rcp_add(uint16_t adc1_val, uint16_t adc2_val, tp_rcp_val start_value,
 int rcp_set_update_adc_values(uint8_t index, uint16_t adc1_val, uint16_t adc2_val);
 
 /**
- * @brief Get current pot value
+ * @brief Update the pot with a block of ADC samples (e.g. a DMA half-buffer).
+ * 		This is the same as calling rcp_set_update_adc_values() for each pair,
+ * 		but without the call overhead, so the pot can be decoded with the raw
+ * 		ADC conversions when low latency is needed.
+ * @param[in] index The index of the pot
+ * @param[in] adc1 Array with the ADC values of the first gang pot
+ * @param[in] adc2 Array with the ADC values of the second gang pot
+ * @param[in] n The number of samples in each array
+ * @return int The number of samples that were out of the dead-zone, or <0 on error
+ */
+int rcp_update_block(uint8_t index, const uint16_t *adc1, const uint16_t *adc2, size_t n);
+
+/**
+ * @brief Get the absolute angle of the pot inside the period of the gangs
+ * 		waveforms. The angle is calculated with integer math from the last
+ * 		ADC values of both gangs, therefore it has a resolution of about
+ * 		4 * (max_adc_val - min_adc_val) / 2 positions per period.
+ * @param[in] index The pot index
+ * @return uint16_t The angle in Q16, where 65536 is a full period
+ */
+uint16_t rcp_get_angle(uint8_t index);
+
+/**
+ * @brief Get the pending value changes of all the pots. The decoder pushes
+ * 		an event every time a pot value changes (once per block with
+ * 		rcp_update_block()) and this pops them in the order they happened.
+ * 		The queue is single producer, single consumer and lock-free, so the
+ * 		decoder can run in an interrupt and this in the main loop, as long as
+ * 		each side runs in only one context.
+ * @param[out] events The buffer for the events
+ * @param[in] max The max number of events to get
+ * @return size_t The number of events that were copied to the buffer
+ */
+size_t rcp_get_events(struct rcp_event *events, size_t max);
+
+/**
+ * @brief Get the number of events that were dropped because the queue
+ * 		was full. Drain the queue more often or increase RCP_EVENT_QUEUE_SIZE.
+ * @return uint32_t The dropped events
+ */
+uint32_t rcp_get_event_overflows(void);
+
+/**
+ * @brief Get the multi-turn position of the pot. This is the number of
+ * 		quadrant transitions since rcp_add() (+ when turning right and - when
+ * 		turning left) and, unlike the value, it's not clamped to [min, max],
+ * 		so it keeps tracking the shaft after the value saturates.
+ * 		For the position inside the current quadrant use rcp_get_angle().
+ * @param[in] index The pot index
+ * @return int64_t The position in quadrants
+ */
+int64_t rcp_get_position(uint8_t index);
+
+/**
+ * @brief Get the number of full turns of the pot since rcp_add(). This is
+ * 		the position rounded down to RCP_QUARTERS_PER_REV, so it's -1 just
+ * 		after the pot turned left from the initial position.
+ * @param[in] index The pot index
+ * @return int64_t The revolutions
+ */
+int64_t rcp_get_revolutions(uint8_t index);
+
+/**
+ * @brief Get the number of quadrants that were skipped because the pot
+ * 		turned more than one quadrant between two decoded samples. These
+ * 		are recovered from the direction of the previous steps, but if this
+ * 		counter increases fast, then the sample rate is too low for the
+ * 		rotation speed.
+ * @param[in] index The pot index
+ * @return uint32_t The number of skipped quadrants
+ */
+uint32_t rcp_get_skipped(uint8_t index);
+
+/**
+ * @brief Get the maximum rotation speed that can be tracked for a decoded
+ * 		sample rate. The direction is unambiguous while the pot turns less
+ * 		than 1 quadrant per sample, which is a quarter of a period of the
+ * 		gangs waveforms.
+ * 		The skipped quadrant recovery extends this up to (but less than)
+ * 		2 quadrants per sample only while the pot keeps turning to the same
+ * 		direction. A skip takes the direction of the last step, so a faster
+ * 		reversal is decoded to the wrong direction.
+ * 		Have in mind that the decoded sample rate is the rate that
+ * 		rcp_set_update_adc_values() is called, not the raw ADC rate, and
+ * 		that a low-pass filter on the ADC samples can't pass a quadrant
+ * 		that is shorter than its window.
+ * @param[in] sample_rate_hz The decoded sample rate in Hz
+ * @return uint32_t The max speed in waveform periods per minute
+ */
+uint32_t rcp_get_max_speed(uint32_t sample_rate_hz);
+
+/**
+ * @brief Get current pot value. This is calculated from the ticks as
+ * 		start_value + ticks * step, clamped in [min, max].
  * @param[in] index The pot index
  * @return tp_rcp_val The value of the pot
  */
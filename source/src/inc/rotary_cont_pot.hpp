@@ -0,0 +1,120 @@
+/*
+ * rotary_cont_pot.hpp
+ *
+ * Header-only C++ wrapper for pots with a configuration that is known at
+ * compile time. It uses the same decoder as rotary_cont_pot.c, but the
+ * ADC midpoints, dead-zone, range and step are template parameters, so
+ * they are folded into immediates and the hot path doesn't load any
+ * configuration from memory.
+ *
+ * The range and step are given as integers and they are divided by Div,
+ * because the template parameters can't be floats. e.g. a pot with range
+ * [-100, 100] and step 0.25 is:
+ * 		RotaryPot<12, 20, -400, 400, 1, 4> pot(adc1_val, adc2_val);
+ * Hysteresis is the same as rcp_settings.hysteresis, for both gangs.
+ *
+ * The ticks are counted from Min, so they're clamped in a compile time
+ * range. The start value (and set_value()) is therefore rounded up to
+ * Min + n * Step.
+ *
+ * Runtime configured pots still need to use the C API.
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#ifndef ROTARY_CONT_POT_HPP_
+#define ROTARY_CONT_POT_HPP_
+
+#include <stddef.h>
+#include "rotary_cont_pot_decode.h"
+
+template<unsigned AdcBits, unsigned DeadZone, long Min, long Max, long Step, long Div = 1,
+		unsigned Hysteresis = 0>
+class RotaryPot {
+	static_assert(AdcBits > 0 && AdcBits <= 16, "invalid number of ADC bits");
+	static_assert(DeadZone <= 255, "the dead-zone must fit in 8 bits");
+	static_assert(Hysteresis <= 255, "the hysteresis must fit in 8 bits");
+	static_assert(Min < Max, "invalid range");
+	static_assert(Step > 0 && Div > 0, "invalid step");
+
+public:
+	static constexpr uint16_t adc_half = ((1UL << AdcBits) - 1) >> 1;
+	static constexpr tp_rcp_val min = RCP_VAL((double) Min / Div);
+	static constexpr tp_rcp_val max = RCP_VAL((double) Max / Div);
+	static constexpr tp_rcp_val step = RCP_VAL((double) Step / Div);
+	/* The ticks from Min to Max, rounded up */
+	static constexpr int32_t tick_max = ((Max - Min) + Step - 1) / Step;
+	static_assert(((Max - Min) + Step - 1) / Step <= RCP_TICKS_MAX, "too many steps in the range");
+
+	RotaryPot(uint16_t adc1_val, uint16_t adc2_val, tp_rcp_val start_value = RCP_VAL(0)) :
+		m_ticks(rcp_val_steps(min, start_value < min ? min : (start_value > max ? max : start_value), step)),
+		m_quarter(rcp_decode_quarter(adc_half, adc_half, 0, 0, RCP_Q1, adc1_val, adc2_val)),
+		m_last_dir(0),
+		m_adc1(adc1_val),
+		m_adc2(adc2_val)
+	{
+	}
+
+	/**
+	 * @brief Update with a new ADC pair, same as rcp_set_update_adc_values()
+	 * @return int 0 if the value changed, -2 if the sample was in the dead-zone
+	 */
+	int update(uint16_t adc1_val, uint16_t adc2_val)
+	{
+		int8_t dir = rcp_decode_dir(adc_half, adc_half, DeadZone, DeadZone,
+				Hysteresis, Hysteresis, &m_quarter, &m_last_dir, &m_adc1, &m_adc2, adc1_val, adc2_val);
+		if (!dir)
+			return -2;
+		m_ticks = rcp_decode_ticks(m_ticks, 0, tick_max, dir);
+		return 0;
+	}
+
+	/**
+	 * @brief Update with a block of ADC pairs, same as rcp_update_block()
+	 * @return int The number of samples that were out of the dead-zone
+	 */
+	int update_block(const uint16_t *adc1, const uint16_t *adc2, size_t n)
+	{
+		uint8_t quarter = m_quarter;
+		int8_t last_dir = m_last_dir;
+		uint16_t curr1 = m_adc1;
+		uint16_t curr2 = m_adc2;
+		int32_t ticks = m_ticks;
+		int accepted = 0;
+
+		for (size_t i=0; i<n; i++) {
+			int8_t dir = rcp_decode_dir(adc_half, adc_half, DeadZone, DeadZone,
+					Hysteresis, Hysteresis, &quarter, &last_dir, &curr1, &curr2, adc1[i], adc2[i]);
+			ticks = rcp_decode_ticks(ticks, 0, tick_max, dir);
+			accepted += (dir != 0);
+		}
+
+		m_quarter = quarter;
+		m_last_dir = last_dir;
+		m_adc1 = curr1;
+		m_adc2 = curr2;
+		m_ticks = ticks;
+
+		return accepted;
+	}
+
+	tp_rcp_val get_value() const
+	{
+		return rcp_val_from_ticks(min, m_ticks, step, min, max);
+	}
+
+	void set_value(tp_rcp_val value)
+	{
+		if ((value >= min) && (value <= max))
+			m_ticks = rcp_val_steps(min, value, step);
+	}
+
+private:
+	int32_t		m_ticks;
+	uint8_t		m_quarter;
+	int8_t		m_last_dir;
+	uint16_t	m_adc1;
+	uint16_t	m_adc2;
+};
+
+#endif /* ROTARY_CONT_POT_HPP_ */
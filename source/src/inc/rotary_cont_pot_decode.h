@@ -0,0 +1,287 @@
+/*
+ * rotary_cont_pot_decode.h
+ *
+ * The value type and the quadrant decoder of the rotary continuous pot.
+ * The decoder functions get the configuration as plain arguments, so
+ * they're shared by the runtime configured pots in rotary_cont_pot.c and
+ * the compile time specialised pots in rotary_cont_pot.hpp, where the
+ * configuration is folded into immediates.
+ *
+ * This header must be C and C++ compatible.
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#ifndef ROTARY_CONT_POT_DECODE_H_
+#define ROTARY_CONT_POT_DECODE_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* In MCUs that doesn't support hard float then,
+ * you can disable floats for performance. RCP_SUPPORT_FIXED selects
+ * signed Q16.16 fixed point values, which support negative and fractional
+ * ranges without the soft-float calls. If none is enabled then uint16_t
+ * is used.
+ */
+#define RCP_SUPPORT_FLOATS
+//#define RCP_SUPPORT_FIXED
+
+#if defined(RCP_SUPPORT_FLOATS) && defined(RCP_SUPPORT_FIXED)
+#error "Only one of RCP_SUPPORT_FLOATS and RCP_SUPPORT_FIXED can be enabled"
+#endif
+
+/**
+ * RCP_VAL converts a constant to tp_rcp_val (e.g. RCP_VAL(-100.5)) and
+ * RCP_VAL_TO_FLOAT converts a tp_rcp_val to float for printing.
+ */
+#if defined(RCP_SUPPORT_FLOATS)
+typedef float tp_rcp_val;
+#define RCP_VAL(X) ((tp_rcp_val)(X))
+#define RCP_VAL_TO_FLOAT(X) ((float)(X))
+#elif defined(RCP_SUPPORT_FIXED)
+typedef int32_t tp_rcp_val;	// Q16.16
+#define RCP_VAL_Q 16
+#define RCP_VAL(X) ((tp_rcp_val)((X) * (double)(1L << RCP_VAL_Q) + ((X) < 0 ? -0.5 : 0.5)))
+#define RCP_VAL_TO_FLOAT(X) ((float)(X) / (float)(1L << RCP_VAL_Q))
+#else
+typedef uint16_t tp_rcp_val;
+#define RCP_VAL(X) ((tp_rcp_val)(X))
+#define RCP_VAL_TO_FLOAT(X) ((float)(X))
+#endif
+
+/* The difference is signed, so it doesn't wrap when CURR < DEAD_ZONE */
+#define RCP_IS_DEADZONE(DEAD_ZONE,CURR,VAL) \
+			(abs((int32_t)(VAL) - (int32_t)(CURR)) < (int32_t)(DEAD_ZONE))
+
+enum en_rcp_quarters {
+	RCP_Q1,
+	RCP_Q2,
+	RCP_Q3,
+	RCP_Q4
+};
+
+enum en_adc_num {
+	RCP_ADC1 = 0,
+	RCP_ADC2
+};
+
+/**
+ * Quadrant decoding tables.
+ * The quadrant code is a 2-bit value where bit1 is set when ADC1 is above
+ * its midpoint and bit0 when ADC2 is above its midpoint. While the pot is
+ * turned right the code follows the gray sequence Q1(01)->Q2(11)->Q3(10)->Q4(00).
+ */
+static const uint8_t rcp_code_to_quarter[4] = {
+	RCP_Q4, RCP_Q1, RCP_Q3, RCP_Q2
+};
+
+static const uint8_t rcp_quarter_to_code[4] = {
+	1, 3, 2, 0
+};
+
+/* Direction of a quadrant change, indexed by (prev_quarter << 2) | quarter.
+ * 0 means that the quadrant didn't change and then the direction is taken
+ * from the slope of the gang that is active in the quadrant.
+ * RCP_SKIP means that a quadrant was skipped, because the pot turned more
+ * than a quadrant between two samples, and the direction is ambiguous.
+ */
+#define RCP_SKIP	2
+
+static const int8_t rcp_transition[16] = {
+	/*	to:	Q1			Q2			Q3			Q4 */
+	/* Q1 */	0,			+1,			RCP_SKIP,	-1,
+	/* Q2 */	-1,			0,			+1,			RCP_SKIP,
+	/* Q3 */	RCP_SKIP,	-1,			0,			+1,
+	/* Q4 */	+1,			RCP_SKIP,	-1,			0,
+};
+
+/* The gang that changes (and is checked for dead-zone) in each quadrant */
+static const uint8_t rcp_quarter_gang[4] = {
+	RCP_ADC2, RCP_ADC1, RCP_ADC1, RCP_ADC2
+};
+
+/* In Q3 the pot turns right while the active gang decreases */
+static const uint8_t rcp_quarter_slope_inv[4] = {
+	0, 0, 1, 0
+};
+
+/**
+ * @brief Get the quadrant code of an ADC pair without hysteresis
+ * @param[in] half1 The midpoint of the first gang
+ * @param[in] half2 The midpoint of the second gang
+ * @return uint8_t The quadrant code (see rcp_code_to_quarter)
+ */
+static inline uint8_t rcp_decode_code(uint16_t half1, uint16_t half2,
+		uint16_t adc1_val, uint16_t adc2_val)
+{
+	return ((adc1_val > half1) << 1) | (adc2_val >= half2);
+}
+
+/**
+ * @brief Apply the hysteresis to a quadrant code. Each gang is compared with
+ * 		its midpoint with a Schmitt trigger, so a gang that was above the
+ * 		midpoint in prev_code has to go below (half - hyst) to flip and one
+ * 		that was below has to go above (half + hyst). A gang that didn't flip
+ * 		in the raw code can't flip with the hysteresis, so only the flipped
+ * 		gangs are compared again.
+ * @param[in] code The raw quadrant code (rcp_decode_code())
+ * @param[in] prev_code The previous quadrant code
+ * @param[in] hyst1 The hysteresis of the first gang (0 for none)
+ * @param[in] hyst2 The hysteresis of the second gang (0 for none)
+ * @return uint8_t The quadrant code with the hysteresis
+ */
+static inline uint8_t rcp_hyst_code(uint8_t code, uint8_t prev_code,
+		uint16_t half1, uint16_t half2, uint8_t hyst1, uint8_t hyst2,
+		uint16_t adc1_val, uint16_t adc2_val)
+{
+	uint8_t flipped = code ^ prev_code;
+
+	if (flipped & 2) {
+		int32_t thr1 = (int32_t) half1 + hyst1 - (int32_t) (prev_code >> 1) * 2 * hyst1;
+		code = (code & 1) | ((adc1_val > thr1) << 1);
+	}
+	if (flipped & 1) {
+		int32_t thr2 = (int32_t) half2 + hyst2 - (int32_t) (prev_code & 1) * 2 * hyst2;
+		code = (code & 2) | (adc2_val >= thr2);
+	}
+	return code;
+}
+
+/**
+ * @brief Get the quadrant of an ADC pair
+ * @param[in] half1 The midpoint of the first gang
+ * @param[in] half2 The midpoint of the second gang
+ * @param[in] hyst1 The hysteresis of the first gang (0 for none)
+ * @param[in] hyst2 The hysteresis of the second gang (0 for none)
+ * @param[in] prev_quarter The previous quadrant
+ * @return uint8_t The quadrant (en_rcp_quarters)
+ */
+static inline uint8_t rcp_decode_quarter(uint16_t half1, uint16_t half2,
+		uint8_t hyst1, uint8_t hyst2, uint8_t prev_quarter,
+		uint16_t adc1_val, uint16_t adc2_val)
+{
+	uint8_t code = rcp_decode_code(half1, half2, adc1_val, adc2_val);
+	return rcp_code_to_quarter[rcp_hyst_code(code, rcp_quarter_to_code[prev_quarter],
+			half1, half2, hyst1, hyst2, adc1_val, adc2_val)];
+}
+
+/* Max number of ticks from the start value, so ticks + dir never overflows */
+#define RCP_TICKS_MAX	(INT32_MAX >> 1)
+
+/**
+ * @brief Get the number of steps that are needed to go from a value to
+ * 		another, rounded up. The range is calculated in 64 bits, because
+ * 		with Q16.16 values (to - from) overflows for ranges over 32768.
+ * @param[in] from The first value
+ * @param[in] to The last value (>= from)
+ * @param[in] step The step (> 0)
+ * @return int32_t The number of steps, limited to RCP_TICKS_MAX
+ */
+static inline int32_t rcp_val_steps(tp_rcp_val from, tp_rcp_val to, tp_rcp_val step)
+{
+#if defined(RCP_SUPPORT_FLOATS)
+	float range = to - from;
+	float steps = range / step;
+	if (steps >= (float) RCP_TICKS_MAX)
+		return RCP_TICKS_MAX;
+	int32_t n = (int32_t) steps;
+	return (n * step < range) ? n + 1 : n;
+#else
+	int64_t n = ((int64_t) to - from + step - 1) / step;
+	return (n > RCP_TICKS_MAX) ? RCP_TICKS_MAX : (int32_t) n;
+#endif
+}
+
+/**
+ * @brief Get the value of the pot from its ticks. The value is calculated
+ * 		with a single multiplication, so it doesn't drift like when the
+ * 		step is accumulated.
+ * @return tp_rcp_val start + ticks * step clamped in [min, max]
+ */
+static inline tp_rcp_val rcp_val_from_ticks(tp_rcp_val start, int32_t ticks,
+		tp_rcp_val step, tp_rcp_val min, tp_rcp_val max)
+{
+#if defined(RCP_SUPPORT_FLOATS)
+	tp_rcp_val value = start + ticks * step;
+#else
+	int64_t value = (int64_t) start + (int64_t) ticks * step;
+#endif
+	if (value > max) value = max;
+	if (value < min) value = min;
+	return (tp_rcp_val) value;
+}
+
+/**
+ * @brief Move the ticks by dir and clamp them in [tick_min, tick_max]. The
+ * 		ticks are clamped, so the value changes as soon as the pot turns
+ * 		back from the min or max value.
+ */
+static inline int32_t rcp_decode_ticks(int32_t ticks, int32_t tick_min,
+		int32_t tick_max, int8_t dir)
+{
+	ticks += dir;
+	if (ticks > tick_max) ticks = tick_max;
+	if (ticks < tick_min) ticks = tick_min;
+	return ticks;
+}
+
+/**
+ * @brief Decode a new pair of ADC values. The decoder state is passed with
+ * 		pointers so the callers can keep it in registers.
+ * 		The quadrant transitions use the quadrant with the hysteresis, but
+ * 		the slope is taken from the gang that is active in the quadrant
+ * 		without hysteresis, because while a gang is in its hysteresis band
+ * 		the other one is close to its peak.
+ * 		When a quadrant is skipped, the pot is assumed to keep turning to
+ * 		the direction of the last step, so it moves 2 steps to that direction.
+ * 		This is only correct if the direction didn't change, so a reversal
+ * 		at more than 1 quadrant per sample is decoded to the wrong direction.
+ * @param[in] half1 The midpoint of the first gang
+ * @param[in] half2 The midpoint of the second gang
+ * @param[in] dead_zone1 The dead-zone of the first gang
+ * @param[in] dead_zone2 The dead-zone of the second gang
+ * @param[in] hyst1 The hysteresis around the midpoint of the first gang
+ * @param[in] hyst2 The hysteresis around the midpoint of the second gang
+ * @param[in,out] prev_quarter The quadrant of the last accepted sample
+ * @param[in,out] last_dir The direction of the last step (+1/-1 or 0 if none)
+ * @param[in,out] curr1 The last accepted value of the first gang
+ * @param[in,out] curr2 The last accepted value of the second gang
+ * @return int8_t The steps (+1/-1, +2/-2 for a skipped quadrant) or 0 if the
+ * 		sample is in the dead-zone
+ */
+static inline int8_t rcp_decode_dir(uint16_t half1, uint16_t half2,
+		uint8_t dead_zone1, uint8_t dead_zone2, uint8_t hyst1, uint8_t hyst2,
+		uint8_t *prev_quarter, int8_t *last_dir, uint16_t *curr1, uint16_t *curr2,
+		uint16_t adc1_val, uint16_t adc2_val)
+{
+	uint8_t code = rcp_decode_code(half1, half2, adc1_val, adc2_val);
+	uint8_t raw_quarter = rcp_code_to_quarter[code];
+	uint8_t gang = rcp_quarter_gang[raw_quarter];
+	uint16_t curr = (gang == RCP_ADC1) ? adc1_val : adc2_val;
+	uint16_t prev = (gang == RCP_ADC1) ? *curr1 : *curr2;
+	uint8_t dead_zone = (gang == RCP_ADC1) ? dead_zone1 : dead_zone2;
+
+	if (RCP_IS_DEADZONE(dead_zone,prev,curr))
+		return 0;
+
+	/* Use the quadrant transition if there is one, otherwise the slope of the active gang */
+	uint8_t quarter = rcp_code_to_quarter[rcp_hyst_code(code, rcp_quarter_to_code[*prev_quarter],
+			half1, half2, hyst1, hyst2, adc1_val, adc2_val)];
+	uint8_t rising = curr > prev;
+	int8_t slope = ((rising ^ rcp_quarter_slope_inv[raw_quarter]) << 1) - 1;
+	int8_t dir = rcp_transition[(*prev_quarter << 2) | quarter];
+	if (dir == RCP_SKIP)
+		dir = RCP_SKIP * (*last_dir ? *last_dir : slope);
+	dir += (dir == 0) * slope;
+
+	/* update prev/curr values */
+	*prev_quarter = quarter;
+	*last_dir = (dir > 0) - (dir < 0);
+	*curr1 = adc1_val;
+	*curr2 = adc2_val;
+
+	return dir;
+}
+
+#endif /* ROTARY_CONT_POT_DECODE_H_ */
@@ -46,6 +46,8 @@ void DebugMon_Handler(void);
 void PendSV_Handler(void);
 void SysTick_Handler(void);
 void TIM3_IRQHandler(void);
+void DMA1_Channel1_IRQHandler(void);
+void ADC1_2_IRQHandler(void);
 void USART1_IRQHandler(void);
 void USB_LP_CAN1_RX0_IRQHandler(void);
 
@@ -33,25 +33,134 @@
 #include "platform_config.h"
 #include "hw_config.h"
 #include "rotary_cont_pot.h"
+#include "bench.h"
 
 /* Declare glb struct and initialize buffers */
 struct tp_glb glb;
 
-DECLARE_UART_DEV(dbg_uart, USART1, 115200, 256, 10, 1);
+DECLARE_UART_DEV(dbg_uart, USART1, 115200, 256, 10, 1, DEV_UART_DMA_TX | DEV_UART_DMA_RX);
+DECLARE_RCP_BANK(pots, 5);
+
+_Static_assert(ADC_FILTER_CONFIG_VALID(ADC1_FILTER_TYPE, ADC1_FILTER_SHIFT, ADC1_FILTER_GAIN),
+		"invalid ADC1_FILTER_TYPE, ADC1_FILTER_SHIFT or ADC1_FILTER_GAIN");
+_Static_assert(ADC_FILTER_CONFIG_VALID(ADC2_FILTER_TYPE, ADC2_FILTER_SHIFT, ADC2_FILTER_GAIN),
+		"invalid ADC2_FILTER_TYPE, ADC2_FILTER_SHIFT or ADC2_FILTER_GAIN");
+
+/**
+ * Set the ADC sample rate of the current rate controller mode
+ */
+static void adc_rate_apply(void)
+{
+	uint8_t high = (glb.adc_rate.mode == ADC_RATE_HIGH);
+
+	glb.adc_sample_rate = ADC_SampleRate_Configuration(high ? ADC_SAMPLE_RATE_HZ : ADC_LOW_SAMPLE_RATE_HZ);
+	TRACEL(TRACE_LEVEL_ADC, ("rate: %s %lu Hz\n", high ? "high" : "low", (unsigned long) glb.adc_sample_rate));
+}
 
 void main_loop(void)
 {
+	static uint32_t rcp_accepted = 0;
+	static uint32_t rate_window_ms = 0;
+
+	/* The DMA RX frames are ready as soon as the line goes idle */
+	if (dbg_uart.flags & DEV_UART_DMA_RX)
+		dev_uart_update(&dbg_uart);
+
 	/* 1 ms timer */
 	if (glb.tmr_1ms) {
 		glb.tmr_1ms = 0;
 
-		dev_uart_update(&dbg_uart);
+		if (!(dbg_uart.flags & DEV_UART_DMA_RX))
+			dev_uart_update(&dbg_uart);
+
+		if ((++glb.tmr_1000ms) >= 1000) {
+			glb.tmr_1000ms = 0;
+			TRACEL(TRACE_LEVEL_LATENCY, ("latency: %lu cycles, max: %lu cycles, overruns: %lu\n",
+					(unsigned long) glb.rcp_latency, (unsigned long) glb.rcp_latency_max,
+					(unsigned long) glb.adc_overruns));
+			glb.rcp_latency_max = 0;
+
+			if (glb.trace_levels & TRACE_LEVEL_UART) {
+				struct dev_uart_stats stats;
+				dev_uart_get_stats(&dbg_uart, &stats);
+				TRACE(("uart: tx dropped: %lu, tx max: %u, rx max: %u, rx discards: %lu, rx overruns: %lu\n",
+						(unsigned long) stats.tx_dropped, stats.tx_high_water, stats.rx_high_water,
+						(unsigned long) stats.rx_discards, (unsigned long) stats.rx_overruns));
+			}
+		}
+		if (glb.wake_latency) {
+			TRACEL(TRACE_LEVEL_LATENCY, ("wake latency: %lu us\n",
+					(unsigned long) (glb.wake_latency / (SystemCoreClock / 1000000))));
+			glb.wake_latency = 0;
+		}
+	}
+#ifndef RCP_DECODE_IN_ISR
+	if (glb.adc_seq != glb.adc_seq_read) {
+		uint16_t adc1_val, adc2_val;
+		uint32_t seq = adc_pair_read(&adc1_val, &adc2_val);
+
+		/* each pair moves the sequence by 2 */
+		glb.adc_overruns += ((seq - glb.adc_seq_read) >> 1) - 1;
+		glb.adc_seq_read = seq;
+		if (!rcp_set_update_adc_values(0, adc1_val, adc2_val))
+			glb.rcp_accepted++;
+		update_rcp_latency();
 	}
-	if (glb.adc1_ready && glb.adc2_ready) {
-		glb.adc1_ready = 0;
-		glb.adc2_ready = 0;
-		rcp_set_update_adc_values(0, glb.adc1_val, glb.adc2_val);
+#endif
+
+	/* sample rate controller, the idle mode has its own rate */
+	if (!glb.idle) {
+		uint32_t accepted = glb.rcp_accepted;
+		if (adc_rate_add_steps(&glb.adc_rate, accepted - rcp_accepted))
+			adc_rate_apply();
+		rcp_accepted = accepted;
+
+		if ((glb.ticks_ms - rate_window_ms) >= ADC_RATE_WINDOW_MS) {
+			rate_window_ms = glb.ticks_ms;
+			if (adc_rate_window(&glb.adc_rate))
+				adc_rate_apply();
+		}
 	}
+
+	/* pot value changes */
+	struct rcp_event events[8];
+	size_t n = rcp_get_events(events, sizeof(events) / sizeof(events[0]));
+	for (size_t i=0; i<n; i++) {
+		TRACE(("[%d%c]: %.2f\n", events[i].pot, (events[i].direction > 0) ? '+' : '-',
+				RCP_VAL_TO_FLOAT(rcp_get_value(events[i].pot))));
+	}
+
+#ifdef IDLE_MODE
+	static uint8_t idle = 0;
+	static uint32_t idle_accepted = 0;
+
+	/* the wake up restores the high rate */
+	if (idle && !glb.idle)
+		adc_rate_set_mode(&glb.adc_rate, ADC_RATE_HIGH);
+	idle = glb.idle;
+
+	/* a pot that is turned against its min/max doesn't change its value,
+	 * so the activity is any decoded sample out of the dead-zone */
+	if (glb.rcp_accepted != idle_accepted) {
+		idle_accepted = glb.rcp_accepted;
+		glb.last_activity_ms = glb.ticks_ms;
+	}
+	if (!glb.idle && ((glb.ticks_ms - glb.last_activity_ms) >= IDLE_TIMEOUT_MS)) {
+		/* the watchdog must not fire before both gangs are configured,
+		 * and the pair can be read directly with the interrupts disabled */
+		__disable_irq();
+		glb.idle = 1;
+		/* the watchdog compares raw ADC samples */
+		ADC_Idle_Configuration(glb.adc1_val >> ADC1_FILTER_GAIN, glb.adc2_val >> ADC2_FILTER_GAIN,
+				ADC_IDLE_AWD_MARGIN, ADC_IDLE_SAMPLE_RATE_HZ);
+		__enable_irq();
+		idle = 1;
+		TRACEL(TRACE_LEVEL_ADC, ("idle\n"));
+	}
+	/* sleep until the analog watchdog or the SysTick */
+	if (glb.idle)
+		__WFI();
+#endif
 }
 
 int main(void)
@@ -81,17 +190,58 @@ int main(void)
 			,1);
 	dev_uart_add(&dbg_uart);
 
+	/* Cycle counter for the latency measurements */
+	bench_init();
+
 	/* ADC Configuration */
+	adc_filter_init(&glb.adc_filter[0], ADC1_FILTER_TYPE, ADC1_FILTER_SHIFT, ADC1_FILTER_GAIN);
+	adc_filter_init(&glb.adc_filter[1], ADC2_FILTER_TYPE, ADC2_FILTER_SHIFT, ADC2_FILTER_GAIN);
 	ADC_Configuration();
+	adc_rate_init(&glb.adc_rate, ADC_RATE_UP_STEPS, ADC_RATE_DOWN_STEPS, ADC_RATE_TIMEOUT_WINDOWS);
+	glb.adc_sample_rate = ADC_SampleRate_Configuration(ADC_SAMPLE_RATE_HZ);
+
+	/* a pair is decoded when any of the filters outputs */
+	uint32_t decode_rate = adc_filter_output_rate(&glb.adc_filter[0], glb.adc_sample_rate);
+	uint32_t decode_rate2 = adc_filter_output_rate(&glb.adc_filter[1], glb.adc_sample_rate);
+	if (decode_rate < decode_rate2)
+		decode_rate = decode_rate2;
+#ifndef RCP_DECODE_IN_ISR
+	/* only the last filter output of each DMA half is decoded */
+	if (decode_rate > (glb.adc_sample_rate / (ADC_DMA_BUFFER_SIZE / 2)))
+		decode_rate = glb.adc_sample_rate / (ADC_DMA_BUFFER_SIZE / 2);
+#endif
+	/* the filters smear the quadrant edges over their window */
+	uint32_t speed_rate = adc_filter_window_rate(&glb.adc_filter[0], glb.adc_sample_rate);
+	uint32_t speed_rate2 = adc_filter_window_rate(&glb.adc_filter[1], glb.adc_sample_rate);
+	if (speed_rate > speed_rate2)
+		speed_rate = speed_rate2;
+	if (speed_rate > decode_rate)
+		speed_rate = decode_rate;
+	TRACE(("ADC sample rate: %lu Hz, decode rate: %lu Hz, max speed: %lu turns/min, resolution: %d/%d bits\n",
+			(unsigned long) glb.adc_sample_rate, (unsigned long) decode_rate,
+			(unsigned long) rcp_get_max_speed(speed_rate),
+			ADC_BITS + ADC1_FILTER_GAIN, ADC_BITS + ADC2_FILTER_GAIN));
 
 	TRACE(("Application started...\n"));
 
 	/* insert some delay here */
 
-	if (!rcp_init(5)) {
-		DECLARE_RCP_ADC(adc1,0,(1<<12)-1, 20);
-		DECLARE_RCP_ADC(adc2,0,(1<<12)-1, 20);
-		rcp_add(glb.adc1_val, glb.adc2_val, 0, -100.0, 100.0, 0.25, &adc1, &adc2);
+#ifdef BENCHMARK
+	/* the benchmark attaches its own bank, so it runs before the pots bank */
+	bench_run();
+#endif
+
+	if (!rcp_init(&pots)) {
+		/* the dead-zone is in filtered ADC units, so it's finer with the filter gain */
+		DECLARE_RCP_ADC(adc1,0,ADC1_FILTERED_MAX, 20);
+		DECLARE_RCP_ADC(adc2,0,ADC2_FILTERED_MAX, 20);
+		uint16_t adc1_val, adc2_val;
+		/* the pairs that were published during the boot are not overruns */
+		glb.adc_seq_read = adc_pair_read(&adc1_val, &adc2_val);
+		int pot = rcp_add(adc1_val, adc2_val, RCP_VAL(0), RCP_VAL(-100.0), RCP_VAL(100.0), RCP_VAL(0.25), &adc1, &adc2);
+		/* up to 8x steps when a quadrant takes less than 100ms */
+		if (pot >= 0)
+			rcp_set_accel(pot, 100, 8);
 	}
 
 
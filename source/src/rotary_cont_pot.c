@@ -7,85 +7,101 @@
 
 #include "rotary_cont_pot.h"
 
-#define ADC_HALF(INDEX,ADC_INDEX) ((m_pots[INDEX].settings[ADC_INDEX].max_adc_val - m_pots[INDEX].settings[ADC_INDEX].min_adc_val) >> 1)
-#define IS_INCR(VAL1,VAL2) ((VAL1-VAL2) > 0 ? 1 : 0)
-#define IS_DEADZONE(INDEX,ADC_INDEX,VAL) ( \
-			(VAL > (m_pots[INDEX].data[ADC_INDEX].curr_adc_value - m_pots[index].settings[ADC_INDEX].dead_zone)) \
-			&& (VAL < (m_pots[INDEX].data[ADC_INDEX].curr_adc_value + m_pots[index].settings[ADC_INDEX].dead_zone)) \
-					)
+#define ADC_SPAN(SETTINGS) (((SETTINGS)->max_adc_val - (SETTINGS)->min_adc_val) >> 1)
+#define ADC_HALF(SETTINGS) ((SETTINGS)->min_adc_val + (((SETTINGS)->max_adc_val - (SETTINGS)->min_adc_val) >> 1))
 
 enum en_rcp_error {
 	RCP_ERROR_ALREADY_INIT = 1,
 	RCP_ERROR_NOT_INIT,
 	RCP_ERROR_MEMORY,
 	RCP_MAX_POTS,
+	RCP_ERROR_INVALID_ARGS,
 
 };
 
-enum en_rcp_quarters {
-	RCP_Q1,
-	RCP_Q2,
-	RCP_Q3,
-	RCP_Q4
-};
-
-enum en_adc_num {
-	RCP_ADC1 = 0,
-	RCP_ADC2
-};
-
-/**
- * Rotary continuous pot data
+/* In Q1 and Q3 the ADC2 distance from the midpoint grows while turning right,
+ * in Q2 and Q4 the ADC1 distance does.
  */
-struct rcp_data {
-	uint16_t	curr_adc_value;
-	uint16_t	prev_adc_value;
+static const uint8_t m_quarter_angle_gang[4] = {
+	RCP_ADC2, RCP_ADC1, RCP_ADC2, RCP_ADC1
 };
 
+/* pointer to the static bank of pots */
+static struct rcp_bank *m_bank = NULL;
 
-/**
- * Rotary continuous pot data
- * min				: That's the the min value that the pot can take.
- * max				: That's the max value of the pot
- * min_adc_val		: That's the min value that the ADC can measure
- * max_adc_val		: That's the max value that the ADC can measure
- * adc_step			: This value defines the ADC window for which the
- * 						relative value doesn't change. So, if from the
- * 						(curr_value-adc_step) to (curr_adc_value+adc_step)
- * 						the relative pot value is the same
+_Static_assert((RCP_EVENT_QUEUE_SIZE & (RCP_EVENT_QUEUE_SIZE - 1)) == 0,
+		"RCP_EVENT_QUEUE_SIZE must be a power of 2");
+
+/* Event queue. head is written only by the decoder and tail only by
+ * rcp_get_events(). The indexes are free running and they're masked
+ * when the buffer is accessed, so head - tail is the number of events.
  */
-struct rcp_pot {
-	tp_rcp_val		value;
-	tp_rcp_val		min;
-	tp_rcp_val		max;
-	tp_rcp_val		step;
-	uint8_t			prev_quarter;
-	struct rcp_settings settings[2];
-	struct rcp_data  	data[2];
-};
+static struct {
+	struct rcp_event	buffer[RCP_EVENT_QUEUE_SIZE];
+	volatile uint32_t	head;
+	volatile uint32_t	tail;
+	volatile uint32_t	overflows;
+} m_events;
+
+static inline void rcp_push_event(uint8_t index, int32_t delta)
+{
+	uint32_t head = m_events.head;
 
-/* pointer to array of settings and data structures */
-static struct rcp_pot *m_pots = NULL;
-static uint8_t m_max_pots = 0;	// max number of supported pots
-static uint8_t m_next_available_pot = 0;	// when this reaches m_max_pots-1 then no other pots are available
+	if ((head - m_events.tail) >= RCP_EVENT_QUEUE_SIZE) {
+		m_events.overflows++;
+		return;
+	}
+	if (delta > INT16_MAX) delta = INT16_MAX;
+	if (delta < INT16_MIN) delta = INT16_MIN;
+
+	struct rcp_event *event = &m_events.buffer[head & (RCP_EVENT_QUEUE_SIZE - 1)];
+	event->pot = index;
+	event->direction = (delta > 0) ? 1 : -1;
+	event->delta = delta;
+	event->timestamp = RCP_GET_TIME_MS();
+	/* the event must be written before it's published */
+	RCP_MEMORY_BARRIER();
+	m_events.head = head + 1;
+}
+
+static inline uint8_t rcp_get_quarter(const struct rcp_pot_config *cfg, uint16_t adc1_val, uint16_t adc2_val)
+{
+	return rcp_decode_quarter(cfg->adc_half[RCP_ADC1], cfg->adc_half[RCP_ADC2], 0, 0, RCP_Q1, adc1_val, adc2_val);
+}
 
 /**
  *
  */
-int rcp_init(uint8_t num_of_pots)
+int rcp_init(struct rcp_bank *bank)
 {
-	if (m_pots) return -RCP_ERROR_ALREADY_INIT;
-
-	m_max_pots = num_of_pots;
-	m_pots = malloc(m_max_pots * sizeof(struct rcp_pot));
-	if (!m_pots) {
+	if (m_bank) return -RCP_ERROR_ALREADY_INIT;
+	if (!bank || !bank->size || !bank->ticks || !bank->config)
 		return -RCP_ERROR_MEMORY;
-	}
-	TRACE(("Created %d pots\n", num_of_pots));
+
+	m_bank = bank;
+	m_bank->used = 0;
+	TRACE(("Created %d pots\n", m_bank->size));
 
 	return 0;
 }
 
+void rcp_deinit(void)
+{
+	RCP_ENTER_CRITICAL();
+	m_bank = NULL;
+	m_events.head = 0;
+	m_events.tail = 0;
+	m_events.overflows = 0;
+	RCP_EXIT_CRITICAL();
+}
+
+static void rcp_set_start(struct rcp_pot_config *cfg, tp_rcp_val start_value)
+{
+	cfg->start = start_value;
+	cfg->tick_min = -rcp_val_steps(cfg->min, start_value, cfg->step);
+	cfg->tick_max = rcp_val_steps(start_value, cfg->max, cfg->step);
+}
+
 /**
  *
  */
@@ -93,159 +109,305 @@ int rcp_add(uint16_t adc1_val, uint16_t adc2_val, tp_rcp_val start_value,
 		tp_rcp_val min, tp_rcp_val max, tp_rcp_val step,
 		struct rcp_settings *adc1_settings, struct rcp_settings *adc2_settings)
 {
-	int index = 0;
-
-	if (!m_pots)
-		return -RCP_ERROR_ALREADY_INIT;
+	if (!m_bank)
+		return -RCP_ERROR_NOT_INIT;
 
 	/* Enough slots? */
-	if (m_next_available_pot >= m_max_pots)
+	if (m_bank->used >= m_bank->size)
 		return -RCP_MAX_POTS;
 
-	uint8_t i = m_next_available_pot;
+	if ((step <= 0) || (min > max))
+		return -RCP_ERROR_INVALID_ARGS;
+
+	uint8_t i = m_bank->used;
+	struct rcp_pot_config *cfg = &m_bank->config[i];
+
+	if (start_value < min) start_value = min;
+	if (start_value > max) start_value = max;
+
+	cfg->min = min;
+	cfg->max = max;
+	cfg->step = step;
+	rcp_set_start(cfg, start_value);
+	memcpy(&cfg->settings[RCP_ADC1], adc1_settings, sizeof(struct rcp_settings));
+	memcpy(&cfg->settings[RCP_ADC2], adc2_settings, sizeof(struct rcp_settings));
+	cfg->adc_half[RCP_ADC1] = ADC_HALF(adc1_settings);
+	cfg->adc_half[RCP_ADC2] = ADC_HALF(adc2_settings);
+	cfg->adc_inv_span[RCP_ADC1] = (1UL << 30) / (ADC_SPAN(adc1_settings) ? ADC_SPAN(adc1_settings) : 1);
+	cfg->adc_inv_span[RCP_ADC2] = (1UL << 30) / (ADC_SPAN(adc2_settings) ? ADC_SPAN(adc2_settings) : 1);
+
+	m_bank->ticks[i] = 0;
+	m_bank->position[i] = 0;
+	m_bank->quarter[i] = rcp_get_quarter(cfg, adc1_val, adc2_val);
+	m_bank->last_dir[i] = 0;
+	m_bank->skipped[i] = 0;
+	m_bank->adc1[i] = adc1_val;
+	m_bank->adc2[i] = adc2_val;
+	m_bank->last_adc1[i] = adc1_val;
+	m_bank->last_adc2[i] = adc2_val;
+	cfg->accel_threshold_ms = 0;
+	cfg->accel_max = 1;
+	m_bank->trans_ms[i] = RCP_GET_TIME_MS();
+	m_bank->accel[i] = 1;
+
+	TRACE(("Added pot with min:%.2f max:%.2f\n", RCP_VAL_TO_FLOAT(cfg->min), RCP_VAL_TO_FLOAT(cfg->max)));
+	m_bank->used++;
+
+	return i;
+}
+
 
-	m_pots[i].value = start_value;
-	m_pots[i].min = min;
-	m_pots[i].max = max;
-	m_pots[i].step = step;
-	memcpy(&m_pots[i].settings[RCP_ADC1], adc1_settings, sizeof(struct rcp_settings));
-	memcpy(&m_pots[i].settings[RCP_ADC2], adc2_settings, sizeof(struct rcp_settings));
+static inline int32_t rcp_step_ticks(const struct rcp_pot_config *cfg, int32_t ticks, int8_t dir)
+{
+	return rcp_decode_ticks(ticks, cfg->tick_min, cfg->tick_max, dir);
+}
 
-	m_pots[i].data[RCP_ADC1].curr_adc_value = adc1_val;
-	m_pots[i].data[RCP_ADC1].prev_adc_value = adc1_val;
+static inline int8_t rcp_decode(const struct rcp_pot_config *cfg, uint8_t *prev_quarter,
+		int8_t *last_dir, uint16_t *curr1, uint16_t *curr2, uint16_t adc1_val, uint16_t adc2_val)
+{
+	return rcp_decode_dir(cfg->adc_half[RCP_ADC1], cfg->adc_half[RCP_ADC2],
+			cfg->settings[RCP_ADC1].dead_zone, cfg->settings[RCP_ADC2].dead_zone,
+			cfg->settings[RCP_ADC1].hysteresis, cfg->settings[RCP_ADC2].hysteresis,
+			prev_quarter, last_dir, curr1, curr2, adc1_val, adc2_val);
+}
 
-	m_pots[i].data[RCP_ADC2].curr_adc_value = adc2_val;
-	m_pots[i].data[RCP_ADC2].prev_adc_value = adc2_val;
+int rcp_set_accel(uint8_t index, uint16_t threshold_ms, uint8_t max_mult)
+{
+	if (!m_bank || index >= m_bank->used) return -1;
+	if (!max_mult || max_mult > RCP_ACCEL_MAX_MULT) return -1;
 
-	TRACE(("Added pot with min:%.2f max:%.2f\n", m_pots[m_next_available_pot].min, m_pots[m_next_available_pot].max));
-	m_next_available_pot++;
+	struct rcp_pot_config *cfg = &m_bank->config[index];
+	RCP_ENTER_CRITICAL();
+	cfg->accel_threshold_ms = threshold_ms;
+	cfg->accel_max = max_mult;
+	m_bank->trans_ms[index] = RCP_GET_TIME_MS();
+	m_bank->accel[index] = 1;
+	RCP_EXIT_CRITICAL();
 
-	return index;
+	return 0;
 }
 
-
-static inline uint8_t rcp_get_quarter(uint8_t index, uint16_t adc1_val, uint16_t adc2_val)
+/**
+ * Update the step multiplier after a number of quadrant transitions.
+ * The multiplier is kept between the transitions and it's reset when
+ * there isn't a transition for longer than the threshold.
+ */
+static inline uint8_t rcp_update_accel(const struct rcp_pot_config *cfg, uint8_t index,
+		uint32_t transitions)
 {
-	uint8_t quarter = RCP_Q1;
-
-	if ( (adc1_val <= ADC_HALF(index,RCP_ADC1)) &&
-			(adc2_val >= ADC_HALF(index,RCP_ADC2)) ) {
-		quarter = RCP_Q1;
+	uint32_t now = RCP_GET_TIME_MS();
+	uint32_t elapsed = now - m_bank->trans_ms[index];
+
+	if (transitions) {
+		uint32_t interval = elapsed / transitions;
+		uint32_t mult = interval ? cfg->accel_threshold_ms / interval : cfg->accel_max;
+		if (mult < 1) mult = 1;
+		if (mult > cfg->accel_max) mult = cfg->accel_max;
+		m_bank->accel[index] = mult;
+		m_bank->trans_ms[index] = now;
 	}
-	else if ( (adc1_val >= ADC_HALF(index,RCP_ADC1)) &&
-			(adc2_val >= ADC_HALF(index,RCP_ADC2)) ) {
-		quarter = RCP_Q2;
+	else if (elapsed >= cfg->accel_threshold_ms) {
+		m_bank->accel[index] = 1;
 	}
-	else if ( (adc1_val >= ADC_HALF(index,RCP_ADC1)) &&
-			(adc2_val <= ADC_HALF(index,RCP_ADC2)) ) {
-		quarter = RCP_Q3;
+	return m_bank->accel[index];
+}
+
+/* The signed number of quadrants between two quadrants. A skipped
+ * quadrant takes the direction of the step.
+ */
+static inline int8_t rcp_quarter_delta(uint8_t from, uint8_t to, int8_t dir)
+{
+	int8_t delta = rcp_transition[(from << 2) | to];
+	if (delta == RCP_SKIP)
+		delta = (dir > 0) ? RCP_SKIP : -RCP_SKIP;
+	return delta;
+}
+
+int rcp_set_update_adc_values(uint8_t index, uint16_t adc1_val, uint16_t adc2_val)
+{
+	if (!m_bank || index >= m_bank->used) return -1;
+
+	const struct rcp_pot_config *cfg = &m_bank->config[index];
+
+	m_bank->last_adc1[index] = adc1_val;
+	m_bank->last_adc2[index] = adc2_val;
+
+	uint8_t prev_quarter = m_bank->quarter[index];
+	int8_t dir = rcp_decode(cfg, &m_bank->quarter[index], &m_bank->last_dir[index],
+			&m_bank->adc1[index], &m_bank->adc2[index], adc1_val, adc2_val);
+	if (!dir)
+		return -2;
+	if (dir == RCP_SKIP || dir == -RCP_SKIP)
+		m_bank->skipped[index]++;
+	int8_t delta = rcp_quarter_delta(prev_quarter, m_bank->quarter[index], dir);
+	m_bank->position[index] += delta;
+	if (cfg->accel_max > 1)
+		dir *= rcp_update_accel(cfg, index, abs(delta));
+
+	int32_t ticks = m_bank->ticks[index];
+	m_bank->ticks[index] = rcp_step_ticks(cfg, ticks, dir);
+	if (m_bank->ticks[index] != ticks)
+		rcp_push_event(index, m_bank->ticks[index] - ticks);
+
+	return 0;
+}
+
+int rcp_update_block(uint8_t index, const uint16_t *adc1, const uint16_t *adc2, size_t n)
+{
+	if (!m_bank || index >= m_bank->used) return -1;
+	if (!n) return 0;
+
+	const struct rcp_pot_config *cfg = &m_bank->config[index];
+
+	/* keep the decoder state in locals for the whole block */
+	uint8_t quarter = m_bank->quarter[index];
+	int8_t last_dir = m_bank->last_dir[index];
+	uint16_t curr1 = m_bank->adc1[index];
+	uint16_t curr2 = m_bank->adc2[index];
+	int32_t ticks = m_bank->ticks[index];
+	int32_t position = 0;
+	int accepted = 0;
+	uint32_t skipped = 0;
+	uint32_t transitions = 0;
+	/* the block has no timestamps per sample, so the multiplier is
+	 * updated once per block from the transitions in the block.
+	 */
+	int8_t mult = (cfg->accel_max > 1) ? rcp_update_accel(cfg, index, 0) : 1;
+
+	for (size_t i=0; i<n; i++) {
+		uint8_t prev_quarter = quarter;
+		int8_t dir = rcp_decode(cfg, &quarter, &last_dir, &curr1, &curr2, adc1[i], adc2[i]);
+		ticks = rcp_step_ticks(cfg, ticks, dir * mult);
+		accepted += (dir != 0);
+		skipped += (dir == RCP_SKIP) || (dir == -RCP_SKIP);
+		int8_t delta = rcp_quarter_delta(prev_quarter, quarter, dir);
+		position += delta;
+		transitions += abs(delta);
 	}
-	else if ( (adc1_val <= ADC_HALF(index,RCP_ADC1)) &&
-			(adc2_val <= ADC_HALF(index,RCP_ADC2)) ) {
-		quarter = RCP_Q4;
+	if (cfg->accel_max > 1)
+		rcp_update_accel(cfg, index, transitions);
+
+	m_bank->quarter[index] = quarter;
+	m_bank->last_dir[index] = last_dir;
+	m_bank->skipped[index] += skipped;
+	m_bank->position[index] += position;
+	m_bank->adc1[index] = curr1;
+	m_bank->adc2[index] = curr2;
+	m_bank->last_adc1[index] = adc1[n-1];
+	m_bank->last_adc2[index] = adc2[n-1];
+	if (ticks != m_bank->ticks[index]) {
+		rcp_push_event(index, ticks - m_bank->ticks[index]);
+		m_bank->ticks[index] = ticks;
 	}
 
-	return quarter;
+	return accepted;
 }
 
-static inline void rcp_increment_value(uint8_t index)
+/**
+ * Both gangs are linear inside a quadrant and one moves away from its
+ * midpoint while the other one moves towards it. Therefore, the position
+ * in the quadrant is the ratio of the growing distance to the sum of the
+ * two distances, which doesn't depend on the amplitude of the waveforms
+ * as long as it's the same for both gangs.
+ */
+uint16_t rcp_get_angle(uint8_t index)
 {
-	if (m_pots[index].value < m_pots[index].max) {
-		tp_rcp_val tmp = m_pots[index].value;
-		tmp += m_pots[index].step;
-		if (tmp > m_pots[index].max)
-			tmp = m_pots[index].max;
-		m_pots[index].value = tmp;
-	}
-	TRACE(("[+]: %.2f\n", (float) m_pots[index].value));
+	if (!m_bank || index >= m_bank->used) return 0;
+
+	const struct rcp_pot_config *cfg = &m_bank->config[index];
+	RCP_ENTER_CRITICAL();
+	uint16_t adc1_val = m_bank->last_adc1[index];
+	uint16_t adc2_val = m_bank->last_adc2[index];
+	RCP_EXIT_CRITICAL();
+	uint8_t quarter = rcp_get_quarter(cfg, adc1_val, adc2_val);
+
+	/* distance of each gang from its midpoint in Q14 of its half range */
+	uint32_t dist[2];
+	dist[RCP_ADC1] = (abs(adc1_val - cfg->adc_half[RCP_ADC1])
+						* cfg->adc_inv_span[RCP_ADC1]) >> 16;
+	dist[RCP_ADC2] = (abs(adc2_val - cfg->adc_half[RCP_ADC2])
+						* cfg->adc_inv_span[RCP_ADC2]) >> 16;
+	if (dist[RCP_ADC1] > (1 << 14)) dist[RCP_ADC1] = 1 << 14;
+	if (dist[RCP_ADC2] > (1 << 14)) dist[RCP_ADC2] = 1 << 14;
+
+	uint32_t sum = dist[RCP_ADC1] + dist[RCP_ADC2];
+	uint32_t frac = sum ? (dist[m_quarter_angle_gang[quarter]] << 14) / sum : 0;
+	if (frac > (1 << 14) - 1) frac = (1 << 14) - 1;
+
+	return (quarter << 14) | frac;
 }
 
-static inline void rcp_decrement_value(uint8_t index)
+size_t rcp_get_events(struct rcp_event *events, size_t max)
 {
-	if (m_pots[index].value > m_pots[index].min) {
-		tp_rcp_val tmp = m_pots[index].value;
-		tmp -= m_pots[index].step;
-		if (tmp < m_pots[index].min)
-			tmp = m_pots[index].min;
-		m_pots[index].value = tmp;
-	}
-	TRACE(("[-]: %.2f\n", (float) m_pots[index].value));
+	uint32_t tail = m_events.tail;
+	uint32_t count = m_events.head - tail;
+	/* read the head before the events */
+	RCP_MEMORY_BARRIER();
+
+	if (count > max)
+		count = max;
+	for (uint32_t i=0; i<count; i++)
+		events[i] = m_events.buffer[(tail + i) & (RCP_EVENT_QUEUE_SIZE - 1)];
+
+	/* the events must be read before their slots are released */
+	RCP_MEMORY_BARRIER();
+	m_events.tail = tail + count;
+
+	return count;
 }
 
+uint32_t rcp_get_event_overflows(void)
+{
+	return m_events.overflows;
+}
 
-int rcp_set_update_adc_values(uint8_t index, uint16_t adc1_val, uint16_t adc2_val)
+int64_t rcp_get_position(uint8_t index)
 {
-	if (index >= m_max_pots) return -1;
-
-	uint8_t quarter = rcp_get_quarter(index, adc1_val, adc2_val);
-
-//	if (quarter != m_pots[index].prev_quarter) {
-//
-//	}
-//	else if (IS_DEADZONE(index,RCP_ADC1,adc1_val) || IS_DEADZONE(index,RCP_ADC2,adc2_val))
-//		return -2;
-
-	uint16_t prev1 = m_pots[index].data[RCP_ADC1].curr_adc_value;
-	uint16_t curr1 = adc1_val;
-	uint16_t prev2 = m_pots[index].data[RCP_ADC2].curr_adc_value;
-	uint16_t curr2 = adc2_val;
-
-	if (quarter == RCP_Q1) {
-		if (IS_DEADZONE(index,RCP_ADC2,adc2_val))
-			return -2;
-		if ( IS_INCR(curr2,prev2)
-				|| (m_pots[index].prev_quarter == RCP_Q4))
-			rcp_increment_value(index);
-		else
-			rcp_decrement_value(index);
-	}
-	else if (quarter == RCP_Q2) {
-		if (IS_DEADZONE(index,RCP_ADC1,adc1_val))
-			return -2;
-		if ( IS_INCR(curr1,prev1)
-				|| (m_pots[index].prev_quarter == RCP_Q1))
-			rcp_increment_value(index);
-		else
-			rcp_decrement_value(index);
-	}
-	else if (quarter == RCP_Q3) {
-		if (IS_DEADZONE(index,RCP_ADC1,adc1_val))
-			return -2;
-		if ( !IS_INCR(curr1,prev1)
-			|| (m_pots[index].prev_quarter == RCP_Q2))
-			rcp_increment_value(index);
-		else
-			rcp_decrement_value(index);
-	}
-	else if (quarter == RCP_Q4) {
-		if (IS_DEADZONE(index,RCP_ADC2,adc2_val))
-			return -2;
-		if ( IS_INCR(curr2,prev2)
-				|| (m_pots[index].prev_quarter == RCP_Q3))
-			rcp_increment_value(index);
-		else
-			rcp_decrement_value(index);
-	}
-//	TRACE(("%d: [1]:%d,[2]:%d\n", quarter, curr1-prev1, curr2-prev2));
+	if (!m_bank || index >= m_bank->used) return 0;
+	RCP_ENTER_CRITICAL();
+	int64_t position = m_bank->position[index];
+	RCP_EXIT_CRITICAL();
+	return position;
+}
+
+int64_t rcp_get_revolutions(uint8_t index)
+{
+	int64_t position = rcp_get_position(index);
+	/* round down, also for negative positions */
+	return (position >= 0) ? position / RCP_QUARTERS_PER_REV
+			: -((-position + RCP_QUARTERS_PER_REV - 1) / RCP_QUARTERS_PER_REV);
+}
 
-	/* update prev/curr values */
-	m_pots[index].prev_quarter = quarter;
-	m_pots[index].data[RCP_ADC1].prev_adc_value = prev1;
-	m_pots[index].data[RCP_ADC1].curr_adc_value = curr1;
-	m_pots[index].data[RCP_ADC2].prev_adc_value = prev2;
-	m_pots[index].data[RCP_ADC2].curr_adc_value = curr2;
+uint32_t rcp_get_skipped(uint8_t index)
+{
+	if (!m_bank || index >= m_bank->used) return 0;
+	return m_bank->skipped[index];
+}
 
-	return 0;
+uint32_t rcp_get_max_speed(uint32_t sample_rate_hz)
+{
+	/* < 1 quadrant per sample and 4 quadrants per period */
+	return (sample_rate_hz * 60) / 4;
 }
 
 tp_rcp_val rcp_get_value(uint8_t index)
 {
-	return m_pots[index].value;
+	if (!m_bank || index >= m_bank->used) return 0;
+
+	const struct rcp_pot_config *cfg = &m_bank->config[index];
+	return rcp_val_from_ticks(cfg->start, m_bank->ticks[index], cfg->step, cfg->min, cfg->max);
 }
 
 void rcp_set_value(uint8_t index, tp_rcp_val value)
 {
-	if ((value >= m_pots[index].min) && (value <= m_pots[index].max)) {
-		m_pots[index].value = value;
+	if (!m_bank || index >= m_bank->used) return;
+
+	struct rcp_pot_config *cfg = &m_bank->config[index];
+
+	if ((value >= cfg->min) && (value <= cfg->max)) {
+		RCP_ENTER_CRITICAL();
+		rcp_set_start(cfg, value);
+		m_bank->ticks[index] = 0;
+		RCP_EXIT_CRITICAL();
 	}
 }
@@ -23,6 +23,8 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "stm32f10x_it.h"
+#include "rotary_cont_pot.h"
+#include "hw_config.h"
 
 /**
  * @brief  This function handles NMI exception.
@@ -116,32 +118,72 @@ void PendSV_Handler(void)
 void SysTick_Handler(void)
 {
 	glb.tmr_1ms++;
+	glb.ticks_ms++;
 }
 
 
-void ADC1_2_IRQHandler(void)
+/**
+ * Filter a half of the ADC DMA buffer. Each word has the ADC1 conversion
+ * in the low and the ADC2 conversion in the high half-word.
+ * When the pots are decoded in the ISR, all the filter outputs are decoded.
+ * The last one is always published for the main loop.
+ */
+static inline void adc_dma_filter(const volatile uint32_t *buffer)
 {
-	if (ADC_GetITStatus(ADC1, ADC_IT_EOC) != RESET) {
-		glb.adc1_temp += ADC_GetConversionValue(ADC1);
-		if ((glb.adc1_counter++) >= 31) {
-			glb.adc1_counter = 0;
-			glb.adc1_ready = 1;
-			glb.adc1_val = glb.adc1_temp >> 5;
-			glb.adc1_temp = 0;
+	uint16_t adc1[ADC_DMA_BUFFER_SIZE / 2];
+	uint16_t adc2[ADC_DMA_BUFFER_SIZE / 2];
+	size_t n = 0;
+
+	for (int i=0; i<(ADC_DMA_BUFFER_SIZE / 2); i++) {
+		uint32_t pair = buffer[i];
+		/* the filters of the gangs can have different kernels, so a pair
+		 * is ready when any of them outputs, with the last value of the other */
+		if (adc_filter_update(&glb.adc_filter[0], pair & 0xFFFF, &adc1[n])
+				| adc_filter_update(&glb.adc_filter[1], pair >> 16, &adc2[n])) {
+			adc1[n] = glb.adc_filter[0].out;
+			adc2[n] = glb.adc_filter[1].out;
+			n++;
 		}
-	    ADC_ClearITPendingBit(ADC1, ADC_IT_EOC);
-	    ADC_ClearITPendingBit(ADC1, ADC_IT_AWD);
 	}
-	if (ADC_GetITStatus(ADC2, ADC_IT_EOC) != RESET) {
-		glb.adc2_temp += ADC_GetConversionValue(ADC2);
-		if ((glb.adc2_counter++) >= 31) {
-			glb.adc2_counter = 0;
-			glb.adc2_ready = 1;
-			glb.adc2_val = glb.adc2_temp >> 5;
-			glb.adc2_temp = 0;
-		}
-	    ADC_ClearITPendingBit(ADC2, ADC_IT_EOC);
-	    ADC_ClearITPendingBit(ADC2, ADC_IT_AWD);
+	if (!n)
+		return;
+
+	adc_pair_publish(adc1[n - 1], adc2[n - 1]);
+	glb.adc_ready_cycles = DWT->CYCCNT;
+
+#ifdef RCP_DECODE_IN_ISR
+	int accepted = rcp_update_block(0, adc1, adc2, n);
+	if (accepted > 0)
+		glb.rcp_accepted += accepted;
+	update_rcp_latency();
+#endif
+}
+
+/**
+ * The analog watchdogs are enabled only in idle mode and they fire
+ * on the first sample that a gang moved.
+ */
+void ADC1_2_IRQHandler(void)
+{
+	if ((ADC_GetITStatus(ADC1, ADC_IT_AWD) != RESET)
+			|| (ADC_GetITStatus(ADC2, ADC_IT_AWD) != RESET)) {
+		glb.wake_cycles = DWT->CYCCNT;
+		glb.adc_sample_rate = ADC_Active_Configuration(ADC_SAMPLE_RATE_HZ);
+		glb.last_activity_ms = glb.ticks_ms;
+		glb.idle = 0;
+	}
+}
+
+void DMA1_Channel1_IRQHandler(void)
+{
+	/* The first half is ready while the DMA writes the second */
+	if (DMA_GetITStatus(DMA1_IT_HT1) != RESET) {
+		DMA_ClearITPendingBit(DMA1_IT_HT1);
+		adc_dma_filter(&glb.adc_dma_buffer[0]);
+	}
+	if (DMA_GetITStatus(DMA1_IT_TC1) != RESET) {
+		DMA_ClearITPendingBit(DMA1_IT_TC1);
+		adc_dma_filter(&glb.adc_dma_buffer[ADC_DMA_BUFFER_SIZE / 2]);
 	}
 }
 